@@ -3,6 +3,14 @@
 #include "expression.h"
 #include "operator.h"
 #include "hashtable.h"
+#include "map.h"
+#include "sorted.h"
+#include "vect.h"
+#include "list.h"
+#include "seq.h"
+#include "range.h"
+#include "coroutine.h"
+#include "kernel.h"
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -30,7 +38,7 @@ static TextBufferObj undefined(TextBufferObj* args) {
     return res;
 }
 
-#define NUM_TYPES 6
+#define NUM_TYPES 12
 static LvString* types[NUM_TYPES];
 
 static void mkTypes(void) {
@@ -39,6 +47,7 @@ static void mkTypes(void) {
         types[i] = lv_alloc(sizeof(LvString) + sizeof(n)); \
         types[i]->len = sizeof(n) - 1; \
         types[i]->refCount = 1; \
+        types[i]->hash = 0; \
         memcpy(types[i]->value, n, sizeof(n))
     INIT(0, "undefined");
     INIT(1, "number");
@@ -46,12 +55,19 @@ static void mkTypes(void) {
     INIT(3, "vect");
     INIT(4, "function");
     INIT(5, "int");
+    INIT(6, "map");
+    INIT(7, "sorted");
+    INIT(8, "list");
+    INIT(9, "seq");
+    INIT(10, "range");
+    INIT(11, "coroutine");
     #undef INIT
 }
 
 /**
  * Returns the type of this object, as a string.
- * Possible types are: "undefined", "number", "int", "string", "vect", "function"
+ * Possible types are: "undefined", "number", "int", "string", "vect", "function", "map",
+ * "sorted", "list", "seq", "range", "coroutine"
  */
 static TextBufferObj typeof_(TextBufferObj* args) {
 
@@ -77,6 +93,24 @@ static TextBufferObj typeof_(TextBufferObj* args) {
         case OPT_FUNCTION_VAL:
             res.str = types[4];
             break;
+        case OPT_MAP:
+            res.str = types[6];
+            break;
+        case OPT_SORTED:
+            res.str = types[7];
+            break;
+        case OPT_LIST:
+            res.str = types[8];
+            break;
+        case OPT_SEQ:
+            res.str = types[9];
+            break;
+        case OPT_RANGE:
+            res.str = types[10];
+            break;
+        case OPT_COROUTINE:
+            res.str = types[11];
+            break;
         default:
             assert(false);
     }
@@ -101,8 +135,8 @@ static int intCmp(uint64_t a, uint64_t b) {
         return 0;
     bool negA = isNegative(a);
     bool negB = isNegative(b);
-    if(negA || negB)
-        return a < b ? 1 : -1;
+    if(negA != negB)
+        return negA ? -1 : 1;
     else
         return a < b ? -1 : 1;
 }
@@ -124,12 +158,19 @@ static double intToNum(uint64_t a) {
 static TextBufferObj cval(TextBufferObj* args) {
 
     TextBufferObj res;
+    res.type = OPT_UNDEFINED;
     if((args[0].type == OPT_CAPTURE)
     && (args[1].type == OPT_INTEGER)
-    && (!isNegative(args[1].integer) && args[1].integer < args[0].capfunc->captureCount)) {
-        res = args[0].capture->value[(size_t)args[1].integer];
-    } else {
-        res.type = OPT_UNDEFINED;
+    && !isNegative(args[1].integer)) {
+        //idx is a param of the enclosing function. The formals are
+        //always captured, but locals the function does not use are not
+        Operator* func = args[0].capture->func;
+        for(int i = 0; i < func->captureCount; i++) {
+            if(func->captures[i] == (int64_t)args[1].integer) {
+                res = args[0].capture->value[i];
+                break;
+            }
+        }
     }
     return res;
 }
@@ -142,29 +183,9 @@ static TextBufferObj cat(TextBufferObj* args) {
 
     TextBufferObj res;
     res.type = OPT_VECT;
-    assert(args[0].type == OPT_VECT);
-    size_t len = 0;
-    for(size_t i = 0; i < args[0].vect->len; i++) {
-        TextBufferObj* obj = &args[0].vect->data[i];
-        len += obj->type == OPT_VECT ? obj->vect->len : 1;
-    }
-    res.vect = lv_alloc(sizeof(LvVect) + len * sizeof(TextBufferObj));
-    res.vect->refCount = 0;
-    res.vect->len = len;
-    size_t idx = 0;
-    for(size_t i = 0; i < args[0].vect->len; i++) {
-        TextBufferObj* obj = &args[0].vect->data[i];
-        if(obj->type == OPT_VECT) {
-            for(int j = 0; j < obj->vect->len; j++) {
-                incRefCount(&obj->vect->data[j]);
-                res.vect->data[idx++] = obj->vect->data[j];
-            }
-        } else {
-            incRefCount(obj);
-            res.vect->data[idx++] = *obj;
-        }
-    }
-    assert(idx == len);
+    //varargs are always packed into a flat vect
+    assert(args[0].type == OPT_VECT && !args[0].vect->tree);
+    res.vect = lv_vect_cat(args[0].vect->data, args[0].vect->len);
     return res;
 }
 
@@ -179,6 +200,13 @@ static TextBufferObj call(TextBufferObj* args) {
     TextBufferObj func = args[0];
     if(args[1].type != OPT_VECT) {
         res.type = OPT_UNDEFINED;
+    } else if(args[1].vect->tree || args[1].vect->packed != OPT_UNDEFINED) {
+        //the arguments must be contiguous and unpacked
+        LvVect* vect = args[1].vect;
+        TextBufferObj* callArgs = lv_alloc(vect->len * sizeof(TextBufferObj));
+        lv_vect_copy(vect, callArgs);
+        lv_callFunction(&func, vect->len, callArgs, &res);
+        lv_free(callArgs);
     } else {
         lv_callFunction(&func, args[1].vect->len, args[1].vect->data, &res);
     }
@@ -186,23 +214,54 @@ static TextBufferObj call(TextBufferObj* args) {
 }
 
 /**
- * Returns the i'th element of the given string or vect.
+ * Returns the given vect with the i'th element
+ * replaced by the given value.
+ */
+static TextBufferObj update(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_VECT && args[1].type == OPT_INTEGER
+        && !isNegative(args[1].integer) && args[1].integer < args[0].vect->len) {
+        res.type = OPT_VECT;
+        res.vect = lv_vect_update(args[0].vect, (size_t)args[1].integer, &args[2]);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/**
+ * Returns the i'th element of the given string, vect, or range,
+ * or the value of the given map associated with the key i.
  */
 static TextBufferObj at(TextBufferObj* args) {
 
     TextBufferObj res;
-    if(args[0].type == OPT_INTEGER) {
+    if(args[1].type == OPT_MAP || args[1].type == OPT_SORTED) {
+        TextBufferObj* value = (args[1].type == OPT_MAP)
+            ? lv_map_get(args[1].map, &args[0])
+            : lv_sorted_get(args[1].sorted, &args[0]);
+        if(value)
+            res = *value;
+        else
+            res.type = OPT_UNDEFINED;
+    } else if(args[0].type == OPT_INTEGER) {
         if(args[1].type == OPT_STRING
         && !isNegative(args[0].integer) && args[0].integer < args[1].str->len) {
             res.type = OPT_STRING;
             res.str = lv_alloc(sizeof(LvString) + 2);
             res.str->refCount = 0;
+            res.str->hash = 0;
             res.str->len = 1;
             res.str->value[0] = args[1].str->value[(size_t)args[0].integer];
             res.str->value[1] = '\0';
         } else if(args[1].type == OPT_VECT
             && !isNegative(args[0].integer) && args[0].integer < args[1].vect->len) {
-            res = args[1].vect->data[(size_t)args[0].integer];
+            res = lv_vect_get(args[1].vect, (size_t)args[0].integer);
+        } else if(args[1].type == OPT_RANGE
+            && !isNegative(args[0].integer) && args[0].integer < args[1].range->len) {
+            res.type = OPT_INTEGER;
+            res.integer = lv_range_at(args[1].range, (size_t)args[0].integer);
         } else {
             res.type = OPT_UNDEFINED;
         }
@@ -212,6 +271,67 @@ static TextBufferObj at(TextBufferObj* args) {
     return res;
 }
 
+/**
+ * Calls the given value with the object protocol's __object__ and
+ * returns whether it answers __yes__. Returns OBJ_UNKNOWN if the
+ * object protocol is not loaded yet.
+ */
+static ObjectLike askObject(TextBufferObj* val) {
+
+    Operator* object = lv_op_getOperator("global:__object__:value", FNS_PREFIX);
+    Operator* yes = lv_op_getOperator("global:__yes__:value", FNS_PREFIX);
+    if(!object || !yes)
+        return OBJ_UNKNOWN;
+    TextBufferObj arg = { .type = OPT_FUNCTION_VAL, .func = object };
+    TextBufferObj res;
+    lv_callFunction(val, 1, &arg, &res);
+    bool isObject = (res.type == OPT_FUNCTION_VAL && res.func == yes);
+    incRefCount(&res);
+    lv_expr_cleanup(&res, 1);
+    return isObject ? OBJ_YES : OBJ_NO;
+}
+
+bool lv_blt_isObjectFunc(Operator* func) {
+
+    if(func->objectLike == OBJ_UNKNOWN) {
+        //functions are pure, so we only need to ask once
+        TextBufferObj fval = { .type = OPT_FUNCTION_VAL, .func = func };
+        func->objectLike = askObject(&fval);
+    }
+    return func->objectLike == OBJ_YES;
+}
+
+/**
+ * Returns whether the argument is object-like, that is, whether it
+ * maps the value __object__ to the value __yes__.
+ */
+static TextBufferObj isObject(TextBufferObj* args) {
+
+    bool isObject = false;
+    switch(args[0].type) {
+        case OPT_FUNCTION_VAL:
+            isObject = lv_blt_isObjectFunc(args[0].func);
+            break;
+        case OPT_CAPTURE: {
+            Operator* func = args[0].capture->func;
+            if(func->objectLike == OBJ_UNKNOWN) {
+                //the answer may depend on the captured values
+                isObject = (askObject(&args[0]) == OBJ_YES);
+            } else {
+                isObject = (func->objectLike == OBJ_YES);
+            }
+            break;
+        }
+        default:
+            //other values don't map function values
+            break;
+    }
+    TextBufferObj res;
+    res.type = OPT_NUMBER;
+    res.number = isObject;
+    return res;
+}
+
 bool lv_blt_toBool(TextBufferObj* obj) {
 
     switch(obj->type) {
@@ -220,6 +340,10 @@ bool lv_blt_toBool(TextBufferObj* obj) {
         case OPT_INTEGER: return obj->integer != 0;
         case OPT_STRING: return obj->str->len != 0;
         case OPT_VECT: return obj->vect->len != 0;
+        case OPT_MAP: return obj->map->len != 0;
+        case OPT_SORTED: return obj->sorted->len != 0;
+        case OPT_LIST: return obj->list->len != 0;
+        case OPT_RANGE: return obj->range->len != 0;
         default: return true;
     }
 }
@@ -236,6 +360,7 @@ static TextBufferObj concat(TextBufferObj* args) {
         size_t blen = args[1].str->len;
         LvString* str = lv_alloc(sizeof(LvString) + alen + blen + 1);
         str->refCount = 0;
+        str->hash = 0;
         str->len = alen + blen;
         memcpy(str->value, args[0].str->value, alen);
         memcpy(str->value + alen, args[1].str->value, blen);
@@ -244,21 +369,31 @@ static TextBufferObj concat(TextBufferObj* args) {
         res.str = str;
     } else if(args[0].type == OPT_VECT && args[1].type == OPT_VECT) {
         //vect concatenation
-        size_t alen = args[0].vect->len;
-        size_t blen = args[1].vect->len;
-        LvVect* vec = lv_alloc(sizeof(LvVect) + (alen + blen) * sizeof(TextBufferObj));
-        vec->refCount = 0;
-        vec->len = alen + blen;
-        for(size_t i = 0; i < alen; i++) {
-            vec->data[i] = args[0].vect->data[i];
-            incRefCount(&vec->data[i]);
-        }
-        for(size_t i = 0; i < blen; i++) {
-            vec->data[alen + i] = args[1].vect->data[i];
-            incRefCount(&vec->data[alen + i]);
-        }
         res.type = OPT_VECT;
-        res.vect = vec;
+        res.vect = lv_vect_concat(args[0].vect, args[1].vect);
+    } else if(args[0].type == OPT_LIST && args[1].type == OPT_LIST) {
+        //list append
+        res.type = OPT_LIST;
+        res.list = lv_list_append(args[0].list, args[1].list);
+    } else if(args[0].type == OPT_MAP && args[1].type == OPT_MAP) {
+        //map union
+        res.type = OPT_MAP;
+        res.map = lv_map_merge(args[0].map, args[1].map);
+    } else if(args[0].type == OPT_SEQ || args[1].type == OPT_SEQ) {
+        //lazy concatenation with a sequence or collection
+        LvSeq* a = lv_seq_of(&args[0]);
+        LvSeq* b = lv_seq_of(&args[1]);
+        if(a && b) {
+            res.type = OPT_SEQ;
+            res.seq = lv_seq_join(SEQ_CONCAT, a, b);
+        } else {
+            res.type = OPT_UNDEFINED;
+            //free the sequences made from collections
+            if(a && a->refCount == 0)
+                lv_seq_free(a);
+            if(b && b->refCount == 0)
+                lv_seq_free(b);
+        }
     } else {
         res.type = OPT_UNDEFINED;
     }
@@ -367,18 +502,149 @@ static TextBufferObj len(TextBufferObj* args) {
             break;
         case OPT_CAPTURE:
             res.type = OPT_INTEGER;
-            res.integer = args[0].capfunc->arity - args[0].capfunc->captureCount;
+            res.integer = args[0].capture->func->arity - args[0].capture->func->captureCount;
             break;
         case OPT_VECT:
             res.type = OPT_INTEGER;
             res.integer = args[0].vect->len;
             break;
+        case OPT_MAP:
+            res.type = OPT_INTEGER;
+            res.integer = args[0].map->len;
+            break;
+        case OPT_SORTED:
+            res.type = OPT_INTEGER;
+            res.integer = args[0].sorted->len;
+            break;
+        case OPT_LIST:
+            res.type = OPT_INTEGER;
+            res.integer = args[0].list->len;
+            break;
+        case OPT_RANGE:
+            res.type = OPT_INTEGER;
+            res.integer = args[0].range->len;
+            break;
         default:
             res.type = OPT_UNDEFINED;
     }
     return res;
 }
 
+/**
+ * Returns the function the given function was specialized from.
+ * Specializations behave the same as their generic function,
+ * so they must compare the same.
+ */
+static Operator* genericFunc(Operator* func) {
+
+    return func->generic ? func->generic : func;
+}
+
+#define FNV_BASIS UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME UINT64_C(0x100000001b3)
+
+static uint64_t mixHash(uint64_t h, uint64_t v) {
+
+    //FNV-1a style combination
+    return (h ^ v) * FNV_PRIME;
+}
+
+/**
+ * Spreads the high bits of the hash into the low bits, which
+ * are what hashtables use. Never returns 0, since cached hashes
+ * use 0 to mean not yet computed.
+ */
+static size_t finishHash(uint64_t h) {
+
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return h ? (size_t)h : 1;
+}
+
+size_t lv_blt_hash(TextBufferObj* obj) {
+
+    uint64_t h = mixHash(FNV_BASIS, obj->type);
+    switch(obj->type) {
+        case OPT_NUMBER:
+            //0.0 and -0.0 are equal
+            return finishHash(mixHash(h, obj->number == 0 ? 0 : obj->integer));
+        case OPT_INTEGER:
+            return finishHash(mixHash(h, obj->integer));
+        case OPT_STRING: {
+            LvString* str = obj->str;
+            if(!str->hash) {
+                for(size_t i = 0; i < str->len; i++)
+                    h = mixHash(h, (unsigned char)str->value[i]);
+                str->hash = finishHash(h);
+            }
+            return str->hash;
+        }
+        case OPT_FUNCTION_VAL:
+            return finishHash(mixHash(h, (uintptr_t)genericFunc(obj->func)));
+        case OPT_CAPTURE: {
+            CaptureObj* capture = obj->capture;
+            if(!capture->hash) {
+                h = mixHash(h, (uintptr_t)genericFunc(capture->func));
+                for(int i = 0; i < capture->func->captureCount; i++)
+                    h = mixHash(h, lv_blt_hash(&capture->value[i]));
+                capture->hash = finishHash(h);
+            }
+            return capture->hash;
+        }
+        case OPT_VECT: {
+            LvVect* vect = obj->vect;
+            if(!vect->hash) {
+                for(size_t i = 0; i < vect->len; i++) {
+                    TextBufferObj elem = lv_vect_get(vect, i);
+                    h = mixHash(h, lv_blt_hash(&elem));
+                }
+                vect->hash = finishHash(h);
+            }
+            return vect->hash;
+        }
+        case OPT_MAP:
+            if(!obj->map->hash)
+                obj->map->hash = finishHash(mixHash(h, lv_map_hashEntries(obj->map)));
+            return obj->map->hash;
+        case OPT_SORTED:
+            if(!obj->sorted->hash)
+                obj->sorted->hash = finishHash(mixHash(h, lv_sorted_hashEntries(obj->sorted)));
+            return obj->sorted->hash;
+        case OPT_LIST: {
+            LvList* list = obj->list;
+            if(!list->hash) {
+                for(LvList* cell = list->len ? list : NULL; cell; cell = cell->tail)
+                    h = mixHash(h, lv_blt_hash(&cell->head));
+                list->hash = finishHash(h);
+            }
+            return list->hash;
+        }
+        case OPT_SEQ:
+        case OPT_COROUTINE:
+            //sequences and coroutines are only equal to themselves
+            return finishHash(mixHash(h, (uintptr_t)obj->seq));
+        case OPT_RANGE: {
+            //ranges with the same elements are equal, whatever their bounds
+            LvRange* range = obj->range;
+            if(!range->hash) {
+                h = mixHash(h, range->len);
+                if(range->len > 0)
+                    h = mixHash(h, range->start);
+                if(range->len > 1)
+                    h = mixHash(h, range->step);
+                range->hash = finishHash(h);
+            }
+            return range->hash;
+        }
+        default:
+            return finishHash(h);
+    }
+}
+
+/** Whether hashes computed for both objects show they are unequal. */
+#define HASHES_DIFFER(a, b) ((a)->hash && (b)->hash && (a)->hash != (b)->hash)
+
 static bool equal(TextBufferObj* a, TextBufferObj* b) {
 
     if(a->type != b->type) {
@@ -395,31 +661,60 @@ static bool equal(TextBufferObj* a, TextBufferObj* b) {
             return a->integer == b->integer;
         case OPT_STRING:
             //strings use value equality
-            return (a->str->len == a->str->len)
-                && (strcmp(a->str->value, b->str->value) == 0);
+            return (a->str->len == b->str->len)
+                && !HASHES_DIFFER(a->str, b->str)
+                && (memcmp(a->str->value, b->str->value, a->str->len) == 0);
         case OPT_FUNCTION_VAL:
             return a->func == b->func;
         case OPT_CAPTURE:
-            if(a->capfunc != b->capfunc)
+            if(genericFunc(a->capture->func) != genericFunc(b->capture->func)
+                || HASHES_DIFFER(a->capture, b->capture))
                 return false;
-            for(int i = 0; i < a->capfunc->captureCount; i++) {
+            for(int i = 0; i < a->capture->func->captureCount; i++) {
                 if(!equal(&a->capture->value[i], &b->capture->value[i]))
                     return false;
             }
             return true;
         case OPT_VECT:
-            if(a->vect->len != b->vect->len)
+            if(a->vect->len != b->vect->len || HASHES_DIFFER(a->vect, b->vect))
                 return false;
             for(size_t i = 0; i < a->vect->len; i++) {
-                if(!equal(&a->vect->data[i], &b->vect->data[i]))
+                TextBufferObj x = lv_vect_get(a->vect, i);
+                TextBufferObj y = lv_vect_get(b->vect, i);
+                if(!equal(&x, &y))
+                    return false;
+            }
+            return true;
+        case OPT_MAP:
+            return !HASHES_DIFFER(a->map, b->map) && lv_map_equal(a->map, b->map);
+        case OPT_SORTED:
+            return !HASHES_DIFFER(a->sorted, b->sorted) && lv_sorted_equal(a->sorted, b->sorted);
+        case OPT_LIST:
+            if(a->list->len != b->list->len || HASHES_DIFFER(a->list, b->list))
+                return false;
+            for(LvList *x = a->list, *y = b->list; x && x != y; x = x->tail, y = y->tail) {
+                if(!equal(&x->head, &y->head))
                     return false;
             }
             return true;
+        case OPT_SEQ:
+            return a->seq == b->seq;
+        case OPT_COROUTINE:
+            return a->coroutine == b->coroutine;
+        case OPT_RANGE:
+            return a->range->len == b->range->len
+                && (a->range->len < 1 || a->range->start == b->range->start)
+                && (a->range->len < 2 || a->range->step == b->range->step);
         default:
             assert(false);
     }
 }
 
+bool lv_blt_equal(TextBufferObj* a, TextBufferObj* b) {
+
+    return equal(a, b);
+}
+
 /**
  * Compares two objects for equality.
  */
@@ -431,6 +726,87 @@ static TextBufferObj eq(TextBufferObj* args) {
     return res;
 }
 
+/**
+ * Hashes an object. Equal objects have equal hashes.
+ */
+static TextBufferObj hash(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_INTEGER;
+    res.integer = lv_blt_hash(&args[0]);
+    return res;
+}
+
+/** A key and value of a map, for ordering maps by their entries. */
+typedef struct MapEntry {
+    TextBufferObj* key;
+    TextBufferObj* value;
+} MapEntry;
+
+static bool addEntry(TextBufferObj* key, TextBufferObj* value, void* data) {
+
+    MapEntry** next = data;
+    (*next)->key = key;
+    (*next)->value = value;
+    ++*next;
+    return true;
+}
+
+static int entryCmp(const void* a, const void* b) {
+
+    return lv_blt_compare(((MapEntry*)a)->key, ((MapEntry*)b)->key);
+}
+
+/** Compares the first nonequal keys or values of entries in order. */
+static bool entriesLt(MapEntry* x, MapEntry* y, size_t len) {
+
+    for(size_t i = 0; i < len; i++) {
+        int cmp = lv_blt_compare(x[i].key, y[i].key);
+        if(cmp == 0)
+            cmp = lv_blt_compare(x[i].value, y[i].value);
+        if(cmp != 0)
+            return cmp < 0;
+    }
+    return false;
+}
+
+/**
+ * Orders maps of the same length like vects of their entries sorted by
+ * key. This only needs to be done when their hashes collide.
+ */
+static bool mapLt(LvMap* a, LvMap* b) {
+
+    if(a->len == 0)
+        return false;
+    MapEntry* x = lv_alloc(2 * a->len * sizeof(MapEntry));
+    MapEntry* y = x + a->len;
+    MapEntry* next = x;
+    lv_map_forEach(a, addEntry, &next);
+    next = y;
+    lv_map_forEach(b, addEntry, &next);
+    qsort(x, a->len, sizeof(MapEntry), entryCmp);
+    qsort(y, b->len, sizeof(MapEntry), entryCmp);
+    bool res = entriesLt(x, y, a->len);
+    lv_free(x);
+    return res;
+}
+
+/** Orders sorted maps of the same length like vects of their entries. */
+static bool sortedLt(LvSorted* a, LvSorted* b) {
+
+    if(a->len == 0)
+        return false;
+    MapEntry* x = lv_alloc(2 * a->len * sizeof(MapEntry));
+    MapEntry* y = x + a->len;
+    MapEntry* next = x;
+    lv_sorted_forEach(a, NULL, NULL, addEntry, &next);
+    next = y;
+    lv_sorted_forEach(b, NULL, NULL, addEntry, &next);
+    bool res = entriesLt(x, y, a->len);
+    lv_free(x);
+    return res;
+}
+
 /**
  * Compares two objects for less than.
  */
@@ -449,36 +825,95 @@ static bool ltImpl(TextBufferObj* a, TextBufferObj* b) {
         case OPT_INTEGER:
             return intCmp(a->integer, b->integer) < 0;
             break;
-        case OPT_STRING:
-            return (strcmp(a->str->value, b->str->value) < 0);
-            break;
+        case OPT_STRING: {
+            size_t len = a->str->len < b->str->len ? a->str->len : b->str->len;
+            int cmp = memcmp(a->str->value, b->str->value, len);
+            return cmp < 0 || (cmp == 0 && a->str->len < b->str->len);
+        }
         case OPT_FUNCTION_VAL:
             return (uintptr_t)a->func < (uintptr_t)b->func;
             break;
         //captures and vects compare the first nonequal values
         case OPT_CAPTURE:
-            if(a->capfunc == b->capfunc) {
-                for(int i = 0; i < a->capfunc->captureCount; i++) {
+            if(genericFunc(a->capture->func) == genericFunc(b->capture->func)) {
+                for(int i = 0; i < a->capture->func->captureCount; i++) {
                     if(!equal(&a->capture->value[i], &b->capture->value[i]))
                         return ltImpl(&a->capture->value[i], &b->capture->value[i]);
                 }
                 return false;
             }
-            return (uintptr_t)a->capfunc < (uintptr_t)b->capfunc;
+            return (uintptr_t)genericFunc(a->capture->func) < (uintptr_t)genericFunc(b->capture->func);
         case OPT_VECT:
             if(a->vect->len == b->vect->len) {
                 for(size_t i = 0; i < a->vect->len; i++) {
-                    if(!equal(&a->vect->data[i], &b->vect->data[i]))
-                        return ltImpl(&a->vect->data[i], &b->vect->data[i]);
+                    TextBufferObj x = lv_vect_get(a->vect, i);
+                    TextBufferObj y = lv_vect_get(b->vect, i);
+                    if(!equal(&x, &y))
+                        return ltImpl(&x, &y);
                 }
                 return false;
             }
             return a->vect->len < b->vect->len;
+        case OPT_LIST:
+            if(a->list->len == b->list->len) {
+                for(LvList *x = a->list, *y = b->list; x && x != y; x = x->tail, y = y->tail) {
+                    if(!equal(&x->head, &y->head))
+                        return ltImpl(&x->head, &y->head);
+                }
+                return false;
+            }
+            return a->list->len < b->list->len;
+        //maps have no natural order, so use an arbitrary one
+        case OPT_MAP: {
+            if(a->map->len != b->map->len)
+                return a->map->len < b->map->len;
+            uint64_t x = lv_blt_hash(a);
+            uint64_t y = lv_blt_hash(b);
+            if(x != y)
+                return x < y;
+            return mapLt(a->map, b->map);
+        }
+        case OPT_SORTED: {
+            if(a->sorted->len != b->sorted->len)
+                return a->sorted->len < b->sorted->len;
+            uint64_t x = lv_blt_hash(a);
+            uint64_t y = lv_blt_hash(b);
+            if(x != y)
+                return x < y;
+            return sortedLt(a->sorted, b->sorted);
+        }
+        case OPT_SEQ:
+            return (uintptr_t)a->seq < (uintptr_t)b->seq;
+        case OPT_COROUTINE:
+            return (uintptr_t)a->coroutine < (uintptr_t)b->coroutine;
+        //ranges compare like vects of their elements
+        case OPT_RANGE:
+            if(a->range->len != b->range->len)
+                return a->range->len < b->range->len;
+            if(a->range->len > 0 && a->range->start != b->range->start)
+                return intCmp(a->range->start, b->range->start) < 0;
+            if(a->range->len > 1)
+                return intCmp(lv_range_at(a->range, 1), lv_range_at(b->range, 1)) < 0;
+            return false;
         default:
             assert(false);
     }
 }
 
+int lv_blt_compare(TextBufferObj* a, TextBufferObj* b) {
+
+    if(a->type == OPT_NUMBER && b->type == OPT_NUMBER) {
+        //NaN is ordered after every other number
+        bool nanA = a->number != a->number;
+        bool nanB = b->number != b->number;
+        if(nanA || nanB)
+            return nanA - nanB;
+    }
+    if(ltImpl(a, b))
+        return -1;
+    return ltImpl(b, a);
+}
+
 static TextBufferObj lt(TextBufferObj* args) {
 
     TextBufferObj res;
@@ -621,6 +1056,75 @@ static TextBufferObj mul(TextBufferObj* args) {
     return res;
 }
 
+/*
+ * Unchecked operations. The type inference pass calls these in place
+ * of the operations above where it has proven the types of the
+ * operands, so they do not look at the types of their arguments.
+ */
+
+static TextBufferObj addInt(TextBufferObj* args) {
+
+    TextBufferObj res = { .type = OPT_INTEGER };
+    res.integer = args[0].integer + args[1].integer;
+    return res;
+}
+
+static TextBufferObj subInt(TextBufferObj* args) {
+
+    TextBufferObj res = { .type = OPT_INTEGER };
+    res.integer = args[0].integer - args[1].integer;
+    return res;
+}
+
+static TextBufferObj mulInt(TextBufferObj* args) {
+
+    TextBufferObj res = { .type = OPT_INTEGER };
+    res.integer = args[0].integer * args[1].integer;
+    return res;
+}
+
+static TextBufferObj ltInt(TextBufferObj* args) {
+
+    TextBufferObj res = { .type = OPT_INTEGER };
+    res.integer = (int64_t)args[0].integer < (int64_t)args[1].integer;
+    return res;
+}
+
+static TextBufferObj geInt(TextBufferObj* args) {
+
+    TextBufferObj res = { .type = OPT_INTEGER };
+    res.integer = (int64_t)args[0].integer >= (int64_t)args[1].integer;
+    return res;
+}
+
+/** Like sys:__eq__, the result is a number. */
+static TextBufferObj eqInt(TextBufferObj* args) {
+
+    TextBufferObj res = { .type = OPT_NUMBER };
+    res.number = args[0].integer == args[1].integer;
+    return res;
+}
+
+static TextBufferObj vectLen(TextBufferObj* args) {
+
+    TextBufferObj res = { .type = OPT_INTEGER };
+    res.integer = args[0].vect->len;
+    return res;
+}
+
+/** Returns the element of the vect at the int index, if it is in bounds. */
+static TextBufferObj vectAt(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[1].integer < args[0].vect->len) {
+        res = lv_vect_get(args[0].vect, (size_t)args[1].integer);
+    } else {
+        //negative indices are out of bounds as well
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
 static uint64_t intDiv(uint64_t a, uint64_t b, bool rem) {
 
     //twos complement division
@@ -805,61 +1309,335 @@ static TextBufferObj neg(TextBufferObj* args) {
     return res;
 }
 
-#define DECL_MATH_FUNC(fnc) \
-static TextBufferObj fnc##_(TextBufferObj* args) { \
-    TextBufferObj res; \
-    if(args[0].type == OPT_NUMBER) { \
-        res.type = OPT_NUMBER; \
-        res.number = fnc(args[0].number); \
-    } else if(args[0].type == OPT_INTEGER) { \
-        res.type = OPT_NUMBER; \
-        res.number = fnc(intToNum(args[0].integer)); \
-    } else { \
-        res.type = OPT_UNDEFINED; \
-    } \
-    return res; \
-}
+//packed vect functions
 
-/* Math functions */
-DECL_MATH_FUNC(sin);
-DECL_MATH_FUNC(cos);
-DECL_MATH_FUNC(tan);
-DECL_MATH_FUNC(asin);
-DECL_MATH_FUNC(acos);
-DECL_MATH_FUNC(atan);
-DECL_MATH_FUNC(sinh);
-DECL_MATH_FUNC(cosh);
-DECL_MATH_FUNC(tanh);
-DECL_MATH_FUNC(exp);
-DECL_MATH_FUNC(log);
-DECL_MATH_FUNC(log10);
-DECL_MATH_FUNC(sqrt);
-DECL_MATH_FUNC(ceil);
-DECL_MATH_FUNC(floor);
-DECL_MATH_FUNC(round);
+/**
+ * A numeric operand of a kernel: a number, an int, or a vect of
+ * numbers and ints, viewed as packed elements.
+ */
+typedef struct NumOperand {
+    bool scalar;
+    OpType type;    //OPT_NUMBER or OPT_INTEGER
+    size_t len;
+    void* elems;    //the doubles or integers
+    NumType value;  //the elements of a scalar
+    LvVect* temp;   //packed storage to free, or NULL
+} NumOperand;
 
-#undef DECL_MATH_FUNC
+/**
+ * Returns a new vect of the elements of a vect of both numbers and ints,
+ * packed as numbers, or NULL if some element is not numeric.
+ */
+static LvVect* packNumbers(LvVect* vect) {
+
+    LvVect* res = lv_vect_newPacked(OPT_NUMBER, vect->len);
+    for(size_t i = 0; i < vect->len; i++) {
+        TextBufferObj el = lv_vect_get(vect, i);
+        if(el.type == OPT_NUMBER) {
+            lv_vect_numbers(res)[i] = el.number;
+        } else if(el.type == OPT_INTEGER) {
+            lv_vect_numbers(res)[i] = intToNum(el.integer);
+        } else {
+            lv_vect_free(res);
+            return NULL;
+        }
+    }
+    return res;
+}
 
-static TextBufferObj abs_(TextBufferObj* args) {
+/** Views the object as a numeric operand. Returns false if it is not numeric. */
+static bool getNumOperand(TextBufferObj* obj, NumOperand* op) {
+
+    op->temp = NULL;
+    if(obj->type == OPT_NUMBER || obj->type == OPT_INTEGER) {
+        op->scalar = true;
+        op->type = obj->type;
+        op->len = 1;
+        op->value.integer = obj->integer;
+        op->elems = &op->value;
+        return true;
+    } else if(obj->type != OPT_VECT) {
+        return false;
+    }
+    LvVect* vect = obj->vect;
+    op->scalar = false;
+    op->len = vect->len;
+    if(vect->packed == OPT_UNDEFINED && vect->len) {
+        op->temp = lv_vect_pack(vect);
+        if(!op->temp)
+            op->temp = packNumbers(vect);
+        if(!op->temp)
+            return false;
+        vect = op->temp;
+    }
+    //the empty vect is a vect of ints
+    op->type = vect->packed == OPT_NUMBER ? OPT_NUMBER : OPT_INTEGER;
+    op->elems = vect->data;
+    return true;
+}
 
-    TextBufferObj res;
-    if(args[0].type == OPT_NUMBER) {
-        res.type = OPT_NUMBER;
-        res.number = fabs(args[0].number);
-    } else if(args[0].type == OPT_INTEGER) {
-        uint64_t a = args[0].integer;
-        res.type = OPT_INTEGER;
-        res.integer = isNegative(a) ? -a : a;
-    } else {
-        res.type = OPT_UNDEFINED;
+/** Converts the elements of the operand to numbers. */
+static void toNumbers(NumOperand* op) {
+
+    if(op->type == OPT_NUMBER)
+        return;
+    op->type = OPT_NUMBER;
+    if(op->scalar) {
+        op->value.number = intToNum(op->value.integer);
+        return;
     }
-    return res;
+    LvVect* numbers = lv_vect_newPacked(OPT_NUMBER, op->len);
+    uint64_t* integers = op->elems;
+    for(size_t i = 0; i < op->len; i++)
+        lv_vect_numbers(numbers)[i] = intToNum(integers[i]);
+    if(op->temp)
+        lv_vect_free(op->temp);
+    op->temp = numbers;
+    op->elems = numbers->data;
 }
 
-static TextBufferObj atan2_(TextBufferObj* args) {
+static void releaseNumOperand(NumOperand* op) {
 
-    TextBufferObj res;
-    NumType nums[2];
+    if(op->temp)
+        lv_vect_free(op->temp);
+}
+
+/**
+ * Applies a kernel to each pair of elements of two numeric vects of the
+ * same length, or of a vect and a number. Ints give ints, except for
+ * division, and comparisons give ints. The result is a packed vect.
+ */
+static TextBufferObj applyKernel(TextBufferObj* args, KernelOp op) {
+
+    TextBufferObj res;
+    res.type = OPT_UNDEFINED;
+    NumOperand a, b;
+    if(!getNumOperand(&args[0], &a))
+        return res;
+    if(!getNumOperand(&args[1], &b)) {
+        releaseNumOperand(&a);
+        return res;
+    }
+    if(!(a.scalar && b.scalar) && (a.scalar || b.scalar || a.len == b.len)) {
+        size_t len = a.scalar ? b.len : a.len;
+        bool integers = a.type == OPT_INTEGER && b.type == OPT_INTEGER && op != KERNEL_DIV;
+        OpType type = (integers || LV_KERNEL_COMPARES(op)) ? OPT_INTEGER : OPT_NUMBER;
+        LvVect* vect = lv_vect_newPacked(type, len);
+        if(integers) {
+            lv_kernel_integers(op, lv_vect_integers(vect), a.elems, a.scalar, b.elems, b.scalar, len);
+        } else {
+            toNumbers(&a);
+            toNumbers(&b);
+            double* x = a.elems;
+            double* y = b.elems;
+            lv_kernel_numbers(op, vect->data, x, a.scalar, y, b.scalar, len);
+            if(op == KERNEL_DIV) {
+                //division by zero is defined by numDiv
+                for(size_t i = 0; i < len; i++) {
+                    double divisor = y[b.scalar ? 0 : i];
+                    if(divisor == 0.0)
+                        lv_vect_numbers(vect)[i] = numDiv(x[a.scalar ? 0 : i], divisor, false);
+                }
+            }
+        }
+        res.type = OPT_VECT;
+        res.vect = vect;
+    }
+    releaseNumOperand(&a);
+    releaseNumOperand(&b);
+    return res;
+}
+
+#define DECL_KERNEL_FUNC(name, op) \
+static TextBufferObj name(TextBufferObj* args) { \
+    return applyKernel(args, op); \
+}
+
+DECL_KERNEL_FUNC(vadd, KERNEL_ADD);
+DECL_KERNEL_FUNC(vsub, KERNEL_SUB);
+DECL_KERNEL_FUNC(vmul, KERNEL_MUL);
+DECL_KERNEL_FUNC(vdiv, KERNEL_DIV);
+DECL_KERNEL_FUNC(vmin, KERNEL_MIN);
+DECL_KERNEL_FUNC(vmax, KERNEL_MAX);
+DECL_KERNEL_FUNC(vlt, KERNEL_LT);
+DECL_KERNEL_FUNC(vle, KERNEL_LE);
+DECL_KERNEL_FUNC(veq, KERNEL_EQ);
+
+#undef DECL_KERNEL_FUNC
+
+/** Packs a new vect built by map or filter if it is long enough to be worth it. */
+static LvVect* packIfLong(LvVect* vect) {
+
+    if(vect->len >= LV_VECT_PACK_MIN) {
+        LvVect* packed = lv_vect_pack(vect);
+        if(packed) {
+            lv_vect_free(vect);
+            return packed;
+        }
+    }
+    return vect;
+}
+
+/** Returns a packed copy of a vect of only numbers or only ints. */
+static TextBufferObj pack(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_VECT) {
+        LvVect* packed = lv_vect_pack(args[0].vect);
+        res = args[0];
+        if(packed)
+            res.vect = packed;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Converts each element of a numeric vect to a number. */
+static TextBufferObj vnum(TextBufferObj* args) {
+
+    TextBufferObj res;
+    NumOperand op;
+    if(args[0].type == OPT_VECT && getNumOperand(&args[0], &op)) {
+        toNumbers(&op);
+        res.type = OPT_VECT;
+        res.vect = lv_vect_newPacked(OPT_NUMBER, op.len);
+        memcpy(res.vect->data, op.elems, op.len * sizeof(double));
+        releaseNumOperand(&op);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/**
+ * Converts each element of a numeric vect to an int, truncating
+ * numbers. Returns undefined if any element is not finite.
+ */
+static TextBufferObj vint(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_UNDEFINED;
+    NumOperand op;
+    if(args[0].type != OPT_VECT || !getNumOperand(&args[0], &op))
+        return res;
+    LvVect* vect = lv_vect_newPacked(OPT_INTEGER, op.len);
+    if(op.type == OPT_INTEGER) {
+        memcpy(vect->data, op.elems, op.len * sizeof(uint64_t));
+    } else {
+        double* numbers = op.elems;
+        for(size_t i = 0; i < op.len; i++) {
+            if(!isfinite(numbers[i])) {
+                lv_vect_free(vect);
+                releaseNumOperand(&op);
+                return res;
+            }
+            lv_vect_integers(vect)[i] = (uint64_t)(int64_t)numbers[i];
+        }
+    }
+    releaseNumOperand(&op);
+    res.type = OPT_VECT;
+    res.vect = vect;
+    return res;
+}
+
+/** Applies a math function to each element of a numeric vect. */
+static TextBufferObj mathVect(TextBufferObj* arg, double (*fnc)(double)) {
+
+    TextBufferObj res;
+    NumOperand op;
+    if(!getNumOperand(arg, &op)) {
+        res.type = OPT_UNDEFINED;
+        return res;
+    }
+    toNumbers(&op);
+    LvVect* vect = lv_vect_newPacked(OPT_NUMBER, op.len);
+    double* numbers = op.elems;
+    //these have vector instructions
+    if(fnc == sqrt) {
+        lv_kernel_sqrt(lv_vect_numbers(vect), numbers, op.len);
+    } else if(fnc == fabs) {
+        lv_kernel_abs(lv_vect_numbers(vect), numbers, op.len);
+    } else {
+        for(size_t i = 0; i < op.len; i++)
+            lv_vect_numbers(vect)[i] = fnc(numbers[i]);
+    }
+    releaseNumOperand(&op);
+    res.type = OPT_VECT;
+    res.vect = vect;
+    return res;
+}
+
+#define DECL_MATH_FUNC(fnc) \
+static TextBufferObj fnc##_(TextBufferObj* args) { \
+    TextBufferObj res; \
+    if(args[0].type == OPT_NUMBER) { \
+        res.type = OPT_NUMBER; \
+        res.number = fnc(args[0].number); \
+    } else if(args[0].type == OPT_INTEGER) { \
+        res.type = OPT_NUMBER; \
+        res.number = fnc(intToNum(args[0].integer)); \
+    } else if(args[0].type == OPT_VECT) { \
+        res = mathVect(&args[0], fnc); \
+    } else { \
+        res.type = OPT_UNDEFINED; \
+    } \
+    return res; \
+}
+
+/* Math functions */
+DECL_MATH_FUNC(sin);
+DECL_MATH_FUNC(cos);
+DECL_MATH_FUNC(tan);
+DECL_MATH_FUNC(asin);
+DECL_MATH_FUNC(acos);
+DECL_MATH_FUNC(atan);
+DECL_MATH_FUNC(sinh);
+DECL_MATH_FUNC(cosh);
+DECL_MATH_FUNC(tanh);
+DECL_MATH_FUNC(exp);
+DECL_MATH_FUNC(log);
+DECL_MATH_FUNC(log10);
+DECL_MATH_FUNC(sqrt);
+DECL_MATH_FUNC(ceil);
+DECL_MATH_FUNC(floor);
+DECL_MATH_FUNC(round);
+
+#undef DECL_MATH_FUNC
+
+static TextBufferObj abs_(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_NUMBER) {
+        res.type = OPT_NUMBER;
+        res.number = fabs(args[0].number);
+    } else if(args[0].type == OPT_INTEGER) {
+        uint64_t a = args[0].integer;
+        res.type = OPT_INTEGER;
+        res.integer = isNegative(a) ? -a : a;
+    } else if(args[0].type == OPT_VECT) {
+        NumOperand op;
+        if(getNumOperand(&args[0], &op) && op.type == OPT_INTEGER) {
+            //ints stay ints
+            uint64_t* integers = op.elems;
+            res.type = OPT_VECT;
+            res.vect = lv_vect_newPacked(OPT_INTEGER, op.len);
+            for(size_t i = 0; i < op.len; i++)
+                lv_vect_integers(res.vect)[i] = isNegative(integers[i]) ? -integers[i] : integers[i];
+        } else {
+            res = mathVect(&args[0], fabs);
+        }
+        releaseNumOperand(&op);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+static TextBufferObj atan2_(TextBufferObj* args) {
+
+    TextBufferObj res;
+    NumType nums[2];
     switch(getObjsAsNumbers(args, nums)) {
         case NR_INTEGER:
             nums[0].number = intToNum(nums[0].integer);
@@ -869,119 +1647,1692 @@ static TextBufferObj atan2_(TextBufferObj* args) {
             res.type = OPT_NUMBER;
             res.number = atan2(nums[0].number, nums[1].number);
             break;
-        case NR_ERROR:
+        case NR_ERROR:
+            res.type = OPT_UNDEFINED;
+            break;
+    }
+    return res;
+}
+
+/** Sign function. Returns +1 for +0 and -1 for -0. */
+static TextBufferObj sgn(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_NUMBER) {
+        res.type = OPT_INTEGER;
+        // (-inf, -0] -> -1 : [+0, inf) -> +1
+        res.integer = 1 - ((bool)signbit(args[0].number) << 1);
+    } else if(args[0].type == OPT_INTEGER) {
+        uint64_t a = args[0].integer;
+        res.type = OPT_INTEGER;
+        //[min, -1] -> -1, [0] -> 0, [1, max] -> +1
+        res.integer = (a && (a < (UINT64_C(1) << 63))) - (a >> 63);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+//map functions
+
+/** Returns the empty map. */
+static TextBufferObj emptyMap(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_MAP;
+    res.map = lv_map_new();
+    return res;
+}
+
+/** Returns the value for the key, or undefined if there is none. */
+static TextBufferObj mapGet(TextBufferObj* args) {
+
+    TextBufferObj res;
+    TextBufferObj* value = NULL;
+    if(args[0].type == OPT_MAP)
+        value = lv_map_get(args[0].map, &args[1]);
+    if(value)
+        res = *value;
+    else
+        res.type = OPT_UNDEFINED;
+    return res;
+}
+
+/** Returns whether the map has a value for the key. */
+static TextBufferObj mapHas(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_MAP) {
+        res.type = OPT_INTEGER;
+        res.integer = lv_map_get(args[0].map, &args[1]) != NULL;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the map with the key associated with the value. */
+static TextBufferObj mapAssoc(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_MAP) {
+        res.type = OPT_MAP;
+        res.map = lv_map_assoc(args[0].map, &args[1], &args[2]);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the map without the key. */
+static TextBufferObj mapDissoc(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_MAP) {
+        res.type = OPT_MAP;
+        res.map = lv_map_dissoc(args[0].map, &args[1]);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the union of the maps, preferring the values of the second. */
+static TextBufferObj mapMerge(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_MAP && args[1].type == OPT_MAP) {
+        res.type = OPT_MAP;
+        res.map = lv_map_merge(args[0].map, args[1].map);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+static bool addKey(TextBufferObj* key, TextBufferObj* value, void* data) {
+
+    LvVect* vect = data;
+    vect->data[vect->len] = *key;
+    incRefCount(&vect->data[vect->len]);
+    vect->len++;
+    return true;
+}
+
+/** Returns a vect of the keys of the map. */
+static TextBufferObj mapKeys(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_MAP) {
+        LvVect* vect = lv_alloc(sizeof(LvVect) + args[0].map->len * sizeof(TextBufferObj));
+        vect->refCount = 0;
+        vect->hash = 0;
+        vect->tree = NULL;
+        vect->packed = OPT_UNDEFINED;
+        vect->len = 0;
+        lv_map_forEach(args[0].map, addKey, vect);
+        res.type = OPT_VECT;
+        res.vect = vect;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/**
+ * The state of map, filter, or fold over the entries of a map.
+ * Entries are passed to the function as { key, value } vects.
+ */
+typedef struct MapApply {
+    TextBufferObj func;
+    TextBufferObj res;  //owned reference
+} MapApply;
+
+/** Calls the function with the { key, value } entry and returns the result, owned. */
+static TextBufferObj applyToEntry(TextBufferObj* func, int numArgs, TextBufferObj* accum,
+    TextBufferObj* key, TextBufferObj* value) {
+
+    TextBufferObj args[2];
+    if(numArgs == 2)
+        args[0] = *accum;
+    TextBufferObj* entry = &args[numArgs - 1];
+    entry->type = OPT_VECT;
+    entry->vect = lv_alloc(sizeof(LvVect) + 2 * sizeof(TextBufferObj));
+    entry->vect->refCount = 1;
+    entry->vect->hash = 0;
+    entry->vect->tree = NULL;
+    entry->vect->packed = OPT_UNDEFINED;
+    entry->vect->len = 2;
+    entry->vect->data[0] = *key;
+    entry->vect->data[1] = *value;
+    incRefCount(key);
+    incRefCount(value);
+    TextBufferObj res;
+    lv_callFunction(func, numArgs, args, &res);
+    incRefCount(&res);
+    lv_expr_cleanup(entry, 1);
+    return res;
+}
+
+static bool mapEntry(TextBufferObj* key, TextBufferObj* value, void* data) {
+
+    MapApply* apply = data;
+    TextBufferObj res = applyToEntry(&apply->func, 1, NULL, key, value);
+    //the function must return a { key, value } entry
+    bool entry = (res.type == OPT_VECT && res.vect->len == 2);
+    if(entry) {
+        TextBufferObj key = lv_vect_get(res.vect, 0);
+        TextBufferObj value = lv_vect_get(res.vect, 1);
+        LvMap* map = lv_map_assoc(apply->res.map, &key, &value);
+        map->refCount++;
+        lv_expr_cleanup(&apply->res, 1);
+        apply->res.map = map;
+    }
+    lv_expr_cleanup(&res, 1);
+    return entry;
+}
+
+static bool filterEntry(TextBufferObj* key, TextBufferObj* value, void* data) {
+
+    MapApply* apply = data;
+    TextBufferObj res = applyToEntry(&apply->func, 1, NULL, key, value);
+    if(!lv_blt_toBool(&res)) {
+        LvMap* map = lv_map_dissoc(apply->res.map, key);
+        map->refCount++;
+        lv_expr_cleanup(&apply->res, 1);
+        apply->res.map = map;
+    }
+    lv_expr_cleanup(&res, 1);
+    return true;
+}
+
+static bool foldEntry(TextBufferObj* key, TextBufferObj* value, void* data) {
+
+    MapApply* apply = data;
+    TextBufferObj res = applyToEntry(&apply->func, 2, &apply->res, key, value);
+    lv_expr_cleanup(&apply->res, 1);
+    apply->res = res;
+    return true;
+}
+
+/**
+ * Maps, filters, or folds the entries of a map with the visitor,
+ * starting from the given value. Returns undefined if the visitor
+ * stops early.
+ */
+static TextBufferObj applyToMap(LvMap* map, MapVisitor visit, TextBufferObj func, TextBufferObj init) {
+
+    MapApply apply = { func, init };
+    incRefCount(&apply.res);
+    if(!lv_map_forEach(map, visit, &apply)) {
+        lv_expr_cleanup(&apply.res, 1);
+        apply.res.type = OPT_UNDEFINED;
+    } else if(apply.res.type & LV_DYNAMIC) {
+        //return the result unowned
+        --*apply.res.refCount;
+    }
+    return apply.res;
+}
+
+//sorted map functions
+
+/** Returns the empty sorted map. */
+static TextBufferObj emptySortedMap(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_SORTED;
+    res.sorted = lv_sorted_new(false);
+    return res;
+}
+
+/** Returns the empty sorted set. */
+static TextBufferObj emptySortedSet(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_SORTED;
+    res.sorted = lv_sorted_new(true);
+    return res;
+}
+
+/** Returns the object, or undefined if it is NULL. */
+static TextBufferObj orUndefined(TextBufferObj* obj) {
+
+    TextBufferObj res;
+    if(obj)
+        res = *obj;
+    else
+        res.type = OPT_UNDEFINED;
+    return res;
+}
+
+/** Returns the value for the key, or undefined if there is none. */
+static TextBufferObj sortedGet(TextBufferObj* args) {
+
+    TextBufferObj* value = NULL;
+    if(args[0].type == OPT_SORTED)
+        value = lv_sorted_get(args[0].sorted, &args[1]);
+    return orUndefined(value);
+}
+
+/** Returns whether the sorted map has a value for the key. */
+static TextBufferObj sortedHas(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_SORTED) {
+        res.type = OPT_INTEGER;
+        res.integer = lv_sorted_get(args[0].sorted, &args[1]) != NULL;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the sorted map with the key associated with the value. */
+static TextBufferObj sortedAssoc(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_SORTED) {
+        res.type = OPT_SORTED;
+        res.sorted = lv_sorted_assoc(args[0].sorted, &args[1], &args[2]);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the sorted map without the key. */
+static TextBufferObj sortedDissoc(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_SORTED) {
+        res.type = OPT_SORTED;
+        res.sorted = lv_sorted_dissoc(args[0].sorted, &args[1]);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the greatest key not greater than the given key. */
+static TextBufferObj sortedFloor(TextBufferObj* args) {
+
+    TextBufferObj* key = NULL;
+    if(args[0].type == OPT_SORTED)
+        key = lv_sorted_floor(args[0].sorted, &args[1]);
+    return orUndefined(key);
+}
+
+/** Returns the least key not less than the given key. */
+static TextBufferObj sortedCeiling(TextBufferObj* args) {
+
+    TextBufferObj* key = NULL;
+    if(args[0].type == OPT_SORTED)
+        key = lv_sorted_ceiling(args[0].sorted, &args[1]);
+    return orUndefined(key);
+}
+
+/** Returns the number of keys less than the given key. */
+static TextBufferObj sortedRank(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_SORTED) {
+        res.type = OPT_INTEGER;
+        res.integer = lv_sorted_rank(args[0].sorted, &args[1]);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the key with the given rank. */
+static TextBufferObj sortedAt(TextBufferObj* args) {
+
+    TextBufferObj* key = NULL;
+    if(args[0].type == OPT_SORTED && args[1].type == OPT_INTEGER && !isNegative(args[1].integer))
+        key = lv_sorted_at(args[0].sorted, args[1].integer);
+    return orUndefined(key);
+}
+
+static bool foldKey(TextBufferObj* key, TextBufferObj* value, void* data) {
+
+    MapApply* apply = data;
+    TextBufferObj args[2] = { apply->res, *key };
+    TextBufferObj res;
+    lv_callFunction(&apply->func, 2, args, &res);
+    incRefCount(&res);
+    lv_expr_cleanup(&apply->res, 1);
+    apply->res = res;
+    return true;
+}
+
+/**
+ * Folds the keys of a sorted set, or the entries of a sorted map,
+ * from lo up to but not including hi. Either bound may be NULL.
+ */
+static TextBufferObj foldSorted(LvSorted* sorted, TextBufferObj* lo, TextBufferObj* hi,
+    TextBufferObj func, TextBufferObj init) {
+
+    MapApply apply = { func, init };
+    incRefCount(&apply.res);
+    lv_sorted_forEach(sorted, lo, hi, sorted->set ? foldKey : foldEntry, &apply);
+    if(apply.res.type & LV_DYNAMIC) {
+        //return the result unowned
+        --*apply.res.refCount;
+    }
+    return apply.res;
+}
+
+/**
+ * Folds the keys from lo up to but not including hi. If hi is
+ * undefined, folds up to the greatest key.
+ */
+static TextBufferObj sortedFoldRange(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_SORTED) {
+        //in case the stack is reallocated
+        TextBufferObj lo = args[1];
+        TextBufferObj hi = args[2];
+        res = foldSorted(args[0].sorted, &lo, hi.type == OPT_UNDEFINED ? NULL : &hi, args[4], args[3]);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+//list functions
+
+/** Returns the empty list. */
+static TextBufferObj emptyList(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_LIST;
+    res.list = lv_list_empty();
+    return res;
+}
+
+/** Returns the list with the given head and tail. */
+static TextBufferObj cons(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[1].type == OPT_LIST) {
+        res.type = OPT_LIST;
+        res.list = lv_list_cons(&args[0], args[1].list);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the first element of a nonempty list. */
+static TextBufferObj listHead(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_LIST && args[0].list->len) {
+        res = args[0].list->head;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns all but the first element of a nonempty list. */
+static TextBufferObj listTail(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_LIST && args[0].list->len) {
+        res.type = OPT_LIST;
+        res.list = lv_list_tail(args[0].list);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the list in reverse order. */
+static TextBufferObj listReverse(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_LIST) {
+        res.type = OPT_LIST;
+        res.list = lv_list_reverse(args[0].list);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns whether the list contains the element. */
+static TextBufferObj listHas(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_LIST) {
+        res.type = OPT_INTEGER;
+        res.integer = 0;
+        for(LvList* cell = args[0].list->len ? args[0].list : NULL; cell; cell = cell->tail) {
+            if(equal(&cell->head, &args[1])) {
+                res.integer = 1;
+                break;
+            }
+        }
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns a vect of the elements of the list, in order. */
+static TextBufferObj listToVect(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_LIST) {
+        size_t len = args[0].list->len;
+        LvVect* vect = lv_alloc(sizeof(LvVect) + len * sizeof(TextBufferObj));
+        vect->refCount = 0;
+        vect->hash = 0;
+        vect->len = 0;
+        vect->tree = NULL;
+        vect->packed = OPT_UNDEFINED;
+        for(LvList* cell = len ? args[0].list : NULL; cell; cell = cell->tail) {
+            vect->data[vect->len] = cell->head;
+            if(cell->head.type & LV_DYNAMIC)
+                ++*cell->head.refCount;
+            vect->len++;
+        }
+        res.type = OPT_VECT;
+        res.vect = packIfLong(vect);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Concatenates a list of lists into a single list. */
+static TextBufferObj listFlatten(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_UNDEFINED;
+    if(args[0].type != OPT_LIST)
+        return res;
+    LvList* lists = args[0].list;
+    ListBuilder builder;
+    lv_list_start(&builder);
+    LvList* last = NULL;
+    for(LvList* cell = lists->len ? lists : NULL; cell; cell = cell->tail) {
+        if(cell->head.type != OPT_LIST) {
+            //discard the partial list
+            TextBufferObj partial = { .type = OPT_LIST, .list = lv_list_finish(&builder, NULL) };
+            incRefCount(&partial);
+            lv_expr_cleanup(&partial, 1);
+            return res;
+        }
+        if(!cell->tail) {
+            //share the last list instead of copying it
+            last = cell->head.list;
+            break;
+        }
+        for(LvList* el = cell->head.list->len ? cell->head.list : NULL; el; el = el->tail)
+            lv_list_push(&builder, &el->head);
+    }
+    res.type = OPT_LIST;
+    res.list = lv_list_finish(&builder, last);
+    return res;
+}
+
+/**
+ * Returns the range of ints from start up to but not including stop,
+ * counting by step. Returns undefined if step is 0, or if the range
+ * has more elements than an int can count.
+ */
+static TextBufferObj range(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_UNDEFINED;
+    if(args[0].type == OPT_INTEGER && args[1].type == OPT_INTEGER && args[2].type == OPT_INTEGER) {
+        res.range = lv_range_new(args[0].integer, args[1].integer, args[2].integer);
+        if(res.range)
+            res.type = OPT_RANGE;
+    }
+    return res;
+}
+
+#define RANGE_FIELD(name, field) \
+static TextBufferObj name(TextBufferObj* args) { \
+    TextBufferObj res; \
+    if(args[0].type == OPT_RANGE) { \
+        res.type = OPT_INTEGER; \
+        res.integer = args[0].range->field; \
+    } else { \
+        res.type = OPT_UNDEFINED; \
+    } \
+    return res; \
+}
+
+/** Returns the start, stop, or step a range was made with. */
+RANGE_FIELD(rangeStart, start)
+RANGE_FIELD(rangeStop, stop)
+RANGE_FIELD(rangeStep, step)
+
+#undef RANGE_FIELD
+
+/** Returns whether the value is an element of the range, in constant time. */
+static TextBufferObj rangeHas(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_RANGE) {
+        res.type = OPT_INTEGER;
+        res.integer = lv_range_has(args[0].range, &args[1]);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/**
+ * Returns a sequence of the elements of a vect, list, or range, or the
+ * characters of a string. Returns a sequence itself.
+ */
+static TextBufferObj seqOf(TextBufferObj* args) {
+
+    TextBufferObj res;
+    LvSeq* seq = lv_seq_of(&args[0]);
+    if(seq) {
+        res.type = OPT_SEQ;
+        res.seq = seq;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the sequence of ints from start up to stop, or unbounded. */
+static TextBufferObj seqRange(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_INTEGER && args[1].type == OPT_UNDEFINED) {
+        res.type = OPT_SEQ;
+        res.seq = lv_seq_from(args[0].integer);
+    } else if(args[0].type == OPT_INTEGER && args[1].type == OPT_INTEGER) {
+        TextBufferObj range = { .type = OPT_RANGE };
+        range.range = lv_range_new(args[0].integer, args[1].integer, 1);
+        res.type = range.range ? OPT_SEQ : OPT_UNDEFINED;
+        if(range.range)
+            res.seq = lv_seq_of(&range);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the sequence of a seed and the results of applying func to it repeatedly. */
+static TextBufferObj seqIterate(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_SEQ;
+    res.seq = lv_seq_iterate(&args[0], &args[1]);
+    return res;
+}
+
+/** Applies a while or flatmap stage to a sequence or collection. */
+static TextBufferObj seqStage(TextBufferObj* args, SeqKind kind) {
+
+    TextBufferObj res;
+    LvSeq* seq = lv_seq_of(&args[0]);
+    if(seq) {
+        res.type = OPT_SEQ;
+        res.seq = lv_seq_apply(kind, seq, &args[1]);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the elements of a sequence up to the first that fails the predicate. */
+static TextBufferObj seqWhile(TextBufferObj* args) {
+
+    return seqStage(args, SEQ_WHILE);
+}
+
+/** Lazily maps each element of a sequence to the elements of a collection. */
+static TextBufferObj seqFlatmap(TextBufferObj* args) {
+
+    return seqStage(args, SEQ_FLATMAP);
+}
+
+/** Returns the sequence of pairs of elements of two sequences or collections. */
+static TextBufferObj seqZip(TextBufferObj* args) {
+
+    TextBufferObj res;
+    LvSeq* a = lv_seq_of(&args[0]);
+    LvSeq* b = lv_seq_of(&args[1]);
+    if(a && b) {
+        res.type = OPT_SEQ;
+        res.seq = lv_seq_join(SEQ_ZIP, a, b);
+    } else {
+        res.type = OPT_UNDEFINED;
+        if(a && a->refCount == 0)
+            lv_seq_free(a);
+        if(b && b->refCount == 0)
+            lv_seq_free(b);
+    }
+    return res;
+}
+
+/**
+ * Iterates over a sequence, or anything sys:seqOf accepts,
+ * collecting its elements into a vect.
+ */
+static TextBufferObj seqToVect(TextBufferObj* args) {
+
+    TextBufferObj res;
+    LvSeq* seq = lv_seq_of(&args[0]);
+    if(!seq) {
+        res.type = OPT_UNDEFINED;
+        return res;
+    }
+    size_t cap = 8;
+    LvVect* vect = lv_alloc(sizeof(LvVect) + cap * sizeof(TextBufferObj));
+    vect->refCount = 0;
+    vect->hash = 0;
+    vect->len = 0;
+    vect->tree = NULL;
+    vect->packed = OPT_UNDEFINED;
+    //the iteration frees a sequence made from a collection
+    SeqIter* iter = lv_seq_iter(seq);
+    TextBufferObj elem;
+    while(lv_seq_next(iter, &elem)) {
+        if(vect->len == cap) {
+            cap *= 2;
+            vect = lv_realloc(vect, sizeof(LvVect) + cap * sizeof(TextBufferObj));
+        }
+        //the vect takes over the reference to the element
+        vect->data[vect->len++] = elem;
+    }
+    lv_seq_endIter(iter);
+    vect = lv_realloc(vect, sizeof(LvVect) + vect->len * sizeof(TextBufferObj));
+    res.type = OPT_VECT;
+    res.vect = packIfLong(vect);
+    return res;
+}
+
+/** Returns a new coroutine that calls func when it is first resumed. */
+static TextBufferObj coroutine(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_COROUTINE;
+    res.coroutine = lv_coroutine_new(&args[0], false);
+    return res;
+}
+
+/**
+ * Returns a new looping coroutine, which calls func with the input when
+ * it is first resumed, and again with the result each time it returns.
+ */
+static TextBufferObj coLoop(TextBufferObj* args) {
+
+    TextBufferObj res;
+    res.type = OPT_COROUTINE;
+    res.coroutine = lv_coroutine_new(&args[0], true);
+    return res;
+}
+
+/**
+ * Resumes the coroutine with the input and returns it once it yields
+ * or returns. The coroutine is resumed in place if the argument holds
+ * the only reference to it, and as a copy if it is shared. Returns
+ * undefined if the coroutine is done or is running.
+ */
+static TextBufferObj resume(TextBufferObj* coroutine, TextBufferObj* input) {
+
+    TextBufferObj res;
+    res.type = OPT_UNDEFINED;
+    if(coroutine->type != OPT_COROUTINE)
+        return res;
+    LvCoroutine* co = coroutine->coroutine;
+    if(co->refCount != 1 || (co->state != CO_NEW && co->state != CO_SUSPENDED))
+        co = lv_coroutine_copy(co);
+    if(!co)
+        return res;
+    TextBufferObj in = *input; //the stack is switched while resuming
+    res.type = OPT_COROUTINE;
+    res.coroutine = co;
+    co->refCount++;
+    lv_resumeCoroutine(co, &in);
+    co->refCount--;
+    return res;
+}
+
+/** Resumes the coroutine with the input, copying it if it is shared. */
+static TextBufferObj coResume(TextBufferObj* args) {
+
+    return resume(&args[0], &args[1]);
+}
+
+/**
+ * Suspends the running coroutine, which gives val to its resumer. Returns
+ * the input the coroutine is resumed with. Returns undefined without
+ * suspending if there is no running coroutine or if called from a function
+ * passed to a builtin.
+ */
+static TextBufferObj coYield(TextBufferObj* args) {
+
+    //the result is a placeholder for the input
+    lv_yieldCoroutine(&args[0]);
+    TextBufferObj res;
+    res.type = OPT_UNDEFINED;
+    return res;
+}
+
+/** Returns whether the coroutine has returned. */
+static TextBufferObj coDone(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_COROUTINE) {
+        res.type = OPT_INTEGER;
+        res.integer = args[0].coroutine->state == CO_DONE;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns the value the coroutine last yielded, or returned if it is done. */
+static TextBufferObj coValue(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_COROUTINE) {
+        res = args[0].coroutine->value;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/**
+ * Returns the generator after its next value. A generator that is done
+ * stays done. Like sys:coResume, the generator is resumed in place if it
+ * is not shared.
+ */
+static TextBufferObj next_(TextBufferObj* args) {
+
+    if(args[0].type == OPT_COROUTINE && args[0].coroutine->state == CO_DONE)
+        return args[0];
+    TextBufferObj input;
+    input.type = OPT_UNDEFINED;
+    return resume(&args[0], &input);
+}
+
+/** Returns the generator resumed with the seed. */
+static TextBufferObj seed_(TextBufferObj* args) {
+
+    return resume(&args[0], &args[1]);
+}
+
+bool lv_blt_isInPlace(Operator* func) {
+
+    if(func->type != FUN_BUILTIN)
+        return false;
+    return func->builtin == coResume || func->builtin == next_ || func->builtin == seed_;
+}
+
+//functional functions
+
+/** Returns the number of elements of a vect or range. */
+static inline size_t indexedLen(TextBufferObj* coll) {
+
+    return coll->type == OPT_RANGE ? coll->range->len : coll->vect->len;
+}
+
+/** Returns the i'th element of a vect or range, which must be in bounds. */
+static inline TextBufferObj indexedElem(TextBufferObj* coll, size_t i) {
+
+    if(coll->type == OPT_RANGE) {
+        TextBufferObj res = { .type = OPT_INTEGER };
+        res.integer = lv_range_at(coll->range, i);
+        return res;
+    }
+    return lv_vect_get(coll->vect, i);
+}
+
+/** Functional map */
+static TextBufferObj map(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_MAP) {
+        TextBufferObj init = { .type = OPT_MAP, .map = lv_map_new() };
+        res = applyToMap(args[0].map, mapEntry, args[1], init);
+    } else if(args[0].type == OPT_SEQ) {
+        res.type = OPT_SEQ;
+        res.seq = lv_seq_apply(SEQ_MAP, args[0].seq, &args[1]);
+    } else if(args[0].type == OPT_LIST) {
+        TextBufferObj func = args[1]; //in case the stack is reallocated
+        LvList* src = args[0].list;
+        ListBuilder builder;
+        lv_list_start(&builder);
+        for(LvList* cell = src->len ? src : NULL; cell; cell = cell->tail) {
+            TextBufferObj obj;
+            lv_callFunction(&func, 1, &cell->head, &obj);
+            lv_list_push(&builder, &obj);
+        }
+        res.type = OPT_LIST;
+        res.list = lv_list_finish(&builder, NULL);
+    } else if(args[0].type == OPT_VECT || args[0].type == OPT_RANGE) {
+        //ranges map to vects
+        TextBufferObj func = args[1]; //in case the stack is reallocated
+        TextBufferObj src = args[0];
+        size_t len = indexedLen(&src);
+        LvVect* vect = lv_alloc(sizeof(LvVect) + len * sizeof(TextBufferObj));
+        vect->refCount = 0;
+        vect->hash = 0;
+        vect->tree = NULL;
+        vect->packed = OPT_UNDEFINED;
+        vect->len = len;
+        for(size_t i = 0; i < len; i++) {
+            TextBufferObj obj;
+            TextBufferObj elem = indexedElem(&src, i);
+            lv_callFunction(&func, 1, &elem, &obj);
+            incRefCount(&obj);
+            vect->data[i] = obj;
+        }
+        res.type = OPT_VECT;
+        res.vect = packIfLong(vect);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Functional filter */
+static TextBufferObj filter(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_MAP) {
+        res = applyToMap(args[0].map, filterEntry, args[1], args[0]);
+    } else if(args[0].type == OPT_SEQ) {
+        res.type = OPT_SEQ;
+        res.seq = lv_seq_apply(SEQ_FILTER, args[0].seq, &args[1]);
+    } else if(args[0].type == OPT_LIST) {
+        TextBufferObj func = args[1];
+        LvList* src = args[0].list;
+        ListBuilder builder;
+        lv_list_start(&builder);
+        for(LvList* cell = src->len ? src : NULL; cell; cell = cell->tail) {
+            TextBufferObj passed;
+            lv_callFunction(&func, 1, &cell->head, &passed);
+            incRefCount(&passed);
+            if(lv_blt_toBool(&passed))
+                lv_list_push(&builder, &cell->head);
+            lv_expr_cleanup(&passed, 1);
+        }
+        res.type = OPT_LIST;
+        res.list = lv_list_finish(&builder, NULL);
+    } else if(args[0].type == OPT_VECT || args[0].type == OPT_RANGE) {
+        TextBufferObj func = args[1];
+        TextBufferObj src = args[0];
+        size_t len = indexedLen(&src);
+        LvVect* vect = lv_alloc(sizeof(LvVect) + len * sizeof(TextBufferObj));
+        vect->refCount = 0;
+        vect->hash = 0;
+        vect->tree = NULL;
+        vect->packed = OPT_UNDEFINED;
+        size_t newLen = 0;
+        for(size_t i = 0; i < len; i++) {
+            TextBufferObj elem = indexedElem(&src, i);
+            TextBufferObj passed;
+            lv_callFunction(&func, 1, &elem, &passed);
+            incRefCount(&passed); //so lv_expr_cleanup doesn't blow up
+            if(lv_blt_toBool(&passed)) {
+                incRefCount(&elem);
+                vect->data[newLen] = elem;
+                newLen++;
+            }
+            lv_expr_cleanup(&passed, 1);
+        }
+        vect->len = newLen;
+        vect = lv_realloc(vect, sizeof(LvVect) + newLen * sizeof(TextBufferObj));
+        res.type = OPT_VECT;
+        res.vect = packIfLong(vect);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Folds the elements of a sequence with the function, in one pull loop. */
+static TextBufferObj foldSeq(LvSeq* seq, TextBufferObj init, TextBufferObj func) {
+
+    TextBufferObj accum[2] = { init };
+    incRefCount(&accum[0]);
+    SeqIter* iter = lv_seq_iter(seq);
+    while(lv_seq_next(iter, &accum[1])) {
+        TextBufferObj tmp;
+        lv_callFunction(&func, 2, accum, &tmp);
+        incRefCount(&tmp);
+        lv_expr_cleanup(accum, 2);
+        accum[0] = tmp;
+    }
+    lv_seq_endIter(iter);
+    //return the accumulator unowned
+    if(accum[0].type & LV_DYNAMIC)
+        --*accum[0].refCount;
+    return accum[0];
+}
+
+/** Functional fold */
+static TextBufferObj fold(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_MAP) {
+        res = applyToMap(args[0].map, foldEntry, args[2], args[1]);
+    } else if(args[0].type == OPT_SORTED) {
+        res = foldSorted(args[0].sorted, NULL, NULL, args[2], args[1]);
+    } else if(args[0].type == OPT_LIST) {
+        LvList* src = args[0].list;
+        TextBufferObj accum[2] = { args[1] };
+        TextBufferObj func = args[2];
+        for(LvList* cell = src->len ? src : NULL; cell; cell = cell->tail) {
+            accum[1] = cell->head;
+            lv_callFunction(&func, 2, accum, &accum[0]);
+        }
+        res = accum[0];
+    } else if(args[0].type == OPT_SEQ) {
+        res = foldSeq(args[0].seq, args[1], args[2]);
+    } else if(args[0].type == OPT_VECT || args[0].type == OPT_RANGE) {
+        TextBufferObj src = args[0];
+        TextBufferObj accum[2] = { args[1] };
+        TextBufferObj func = args[2];
+        size_t len = indexedLen(&src);
+        for(size_t i = 0; i < len; i++) {
+            accum[1] = indexedElem(&src, i);
+            lv_callFunction(&func, 2, accum, &accum[0]);
+        }
+        res = accum[0];
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Iterates over the elements of a vect, list, range, or sequence. */
+typedef struct ElemIter {
+    LvVect* vect;
+    LvList* cell;
+    LvRange* range;
+    size_t idx;
+    SeqIter* seq;
+    TextBufferObj held; //current element of a sequence
+} ElemIter;
+
+/**
+ * Starts iterating over coll. Returns false if it is not a vect,
+ * list, range, or sequence. Otherwise, endElems must be called after.
+ */
+static bool startElems(ElemIter* iter, TextBufferObj* coll) {
+
+    iter->vect = NULL;
+    iter->cell = NULL;
+    iter->range = NULL;
+    iter->idx = 0;
+    iter->seq = NULL;
+    iter->held.type = OPT_UNDEFINED;
+    if(coll->type == OPT_VECT) {
+        iter->vect = coll->vect;
+    } else if(coll->type == OPT_LIST) {
+        iter->cell = coll->list->len ? coll->list : NULL;
+    } else if(coll->type == OPT_RANGE) {
+        iter->range = coll->range;
+    } else if(coll->type == OPT_SEQ) {
+        iter->seq = lv_seq_iter(coll->seq);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Stores the next element in elem, or returns false at the end.
+ * Elements of sequences are only valid until the next call.
+ */
+static bool nextElem(ElemIter* iter, TextBufferObj* elem) {
+
+    if(iter->seq) {
+        lv_expr_cleanup(&iter->held, 1);
+        if(!lv_seq_next(iter->seq, &iter->held)) {
+            iter->held.type = OPT_UNDEFINED;
+            return false;
+        }
+        *elem = iter->held;
+        return true;
+    }
+    if(iter->vect) {
+        if(iter->idx == iter->vect->len)
+            return false;
+        *elem = lv_vect_get(iter->vect, iter->idx++);
+        return true;
+    }
+    if(iter->range) {
+        if(iter->idx == iter->range->len)
+            return false;
+        elem->type = OPT_INTEGER;
+        elem->integer = lv_range_at(iter->range, iter->idx++);
+        return true;
+    }
+    if(!iter->cell)
+        return false;
+    *elem = iter->cell->head;
+    iter->cell = iter->cell->tail;
+    return true;
+}
+
+/** Ends an iteration started by startElems. */
+static void endElems(ElemIter* iter) {
+
+    if(iter->seq) {
+        lv_expr_cleanup(&iter->held, 1);
+        lv_seq_endIter(iter->seq);
+    }
+}
+
+/** Returns the packed element type of a flat vect, or OPT_UNDEFINED. */
+static OpType packedType(ElemIter* iter) {
+
+    if(iter->vect && !iter->vect->tree)
+        return iter->vect->packed;
+    return OPT_UNDEFINED;
+}
+
+/**
+ * A running sum or product. Ints are combined as ints until the
+ * first number, after which everything is widened to numbers,
+ * like a chain of additions would. Sums of numbers carry a
+ * Neumaier compensation term to bound the rounding error.
+ */
+typedef struct Reduction {
+    bool product;
+    bool isNumber;
+    uint64_t integer;
+    double number;
+    double compensation;
+} Reduction;
+
+static void reduceNumber(Reduction* red, double x) {
+
+    if(red->product) {
+        red->number *= x;
+        return;
+    }
+    double sum = red->number + x;
+    if(fabs(red->number) >= fabs(x)) {
+        red->compensation += (red->number - sum) + x;
+    } else {
+        red->compensation += (x - sum) + red->number;
+    }
+    red->number = sum;
+}
+
+/** Adds a value to the reduction. Returns false if it is not numeric. */
+static bool reduceValue(Reduction* red, TextBufferObj* val) {
+
+    if(val->type == OPT_INTEGER && !red->isNumber) {
+        if(red->product) {
+            red->integer *= val->integer;
+        } else {
+            red->integer += val->integer;
+        }
+        return true;
+    }
+    if(val->type != OPT_INTEGER && val->type != OPT_NUMBER)
+        return false;
+    if(!red->isNumber) {
+        red->isNumber = true;
+        red->number = intToNum(red->integer);
+        red->compensation = 0.0;
+    }
+    reduceNumber(red, val->type == OPT_NUMBER ? val->number : intToNum(val->integer));
+    return true;
+}
+
+/**
+ * Sums or multiplies the elements of a vect, list, or sequence of numbers
+ * in a single pass. Returns undefined if any element is not numeric.
+ */
+static TextBufferObj reduce(TextBufferObj* coll, bool product) {
+
+    TextBufferObj res;
+    res.type = OPT_UNDEFINED;
+    ElemIter iter;
+    if(!startElems(&iter, coll))
+        return res;
+    Reduction red = { .product = product, .integer = product };
+    switch(packedType(&iter)) {
+        case OPT_NUMBER: {
+            double* numbers = lv_vect_numbers(iter.vect);
+            red.isNumber = true;
+            red.number = product;
+            for(size_t i = 0; i < iter.vect->len; i++)
+                reduceNumber(&red, numbers[i]);
+            break;
+        }
+        case OPT_INTEGER: {
+            uint64_t* integers = lv_vect_integers(iter.vect);
+            for(size_t i = 0; i < iter.vect->len; i++)
+                red.integer = product ? red.integer * integers[i] : red.integer + integers[i];
+            break;
+        }
+        default: {
+            TextBufferObj elem;
+            bool numeric = true;
+            while(numeric && nextElem(&iter, &elem))
+                numeric = reduceValue(&red, &elem);
+            endElems(&iter);
+            if(!numeric)
+                return res;
+            break;
+        }
+    }
+    if(red.isNumber) {
+        res.type = OPT_NUMBER;
+        //the compensation is meaningless once the sum overflows
+        res.number = isfinite(red.number) ? red.number + red.compensation : red.number;
+    } else {
+        res.type = OPT_INTEGER;
+        res.integer = red.integer;
+    }
+    return res;
+}
+
+/** Returns the sum of a vect, list, or sequence of numbers. */
+static TextBufferObj sum(TextBufferObj* args) {
+
+    return reduce(&args[0], false);
+}
+
+/** Returns the product of a vect, list, or sequence of numbers. */
+static TextBufferObj product(TextBufferObj* args) {
+
+    return reduce(&args[0], true);
+}
+
+/** Compares like sys:__lt__, where NaN compares false. */
+static bool lessThan(TextBufferObj a, TextBufferObj b) {
+
+    TextBufferObj args[2] = { a, b };
+    return lt(args).integer;
+}
+
+/**
+ * Returns the least (or greatest) element of a vect or list according
+ * to sys:__lt__, keeping the first of equal elements. Returns undefined
+ * if there are no elements, or if any element is a function, since
+ * objects may define their own comparison.
+ */
+static TextBufferObj extremum(TextBufferObj* coll, bool greatest) {
+
+    TextBufferObj res;
+    res.type = OPT_UNDEFINED;
+    ElemIter iter;
+    //the result would be owned by the iteration of a sequence
+    if(coll->type == OPT_SEQ || !startElems(&iter, coll))
+        return res;
+    if(packedType(&iter) == OPT_NUMBER && iter.vect->len) {
+        double* numbers = lv_vect_numbers(iter.vect);
+        double best = numbers[0];
+        for(size_t i = 1; i < iter.vect->len; i++) {
+            if(greatest ? best < numbers[i] : numbers[i] < best)
+                best = numbers[i];
+        }
+        res.type = OPT_NUMBER;
+        res.number = best;
+        return res;
+    }
+    if(iter.range && iter.range->len) {
+        //the ends of a range are its extremes
+        bool last = greatest != isNegative(iter.range->step);
+        res.type = OPT_INTEGER;
+        res.integer = lv_range_at(iter.range, last ? iter.range->len - 1 : 0);
+        return res;
+    }
+    TextBufferObj elem;
+    bool first = true;
+    while(nextElem(&iter, &elem)) {
+        if(elem.type == OPT_FUNCTION_VAL || elem.type == OPT_CAPTURE) {
             res.type = OPT_UNDEFINED;
+            return res;
+        }
+        if(first || (greatest ? lessThan(res, elem) : lessThan(elem, res)))
+            res = elem;
+        first = false;
+    }
+    return res;
+}
+
+/** Returns the least element of a vect or list. */
+static TextBufferObj minimum(TextBufferObj* args) {
+
+    return extremum(&args[0], false);
+}
+
+/** Returns the greatest element of a vect or list. */
+static TextBufferObj maximum(TextBufferObj* args) {
+
+    return extremum(&args[0], true);
+}
+
+typedef enum PredStop { STOP_NEVER, STOP_ON_TRUE, STOP_ON_FALSE } PredStop;
+
+/**
+ * Calls the predicate args[1] on the elements of the vect, list, or
+ * sequence args[0] until it returns the value given by stop. Stores the
+ * number of elements tested and passed. Returns false if args[0] is not
+ * a vect, list, or sequence.
+ */
+static bool testElems(TextBufferObj* args, PredStop stop, size_t* tested, size_t* passed) {
+
+    ElemIter iter;
+    if(!startElems(&iter, &args[0]))
+        return false;
+    TextBufferObj func = args[1];
+    TextBufferObj elem;
+    *tested = *passed = 0;
+    while(nextElem(&iter, &elem)) {
+        TextBufferObj res;
+        lv_callFunction(&func, 1, &elem, &res);
+        incRefCount(&res);
+        bool pass = lv_blt_toBool(&res);
+        lv_expr_cleanup(&res, 1);
+        ++*tested;
+        *passed += pass;
+        if((stop == STOP_ON_TRUE && pass) || (stop == STOP_ON_FALSE && !pass))
             break;
     }
+    endElems(&iter);
+    return true;
+}
+
+/** Returns the number of elements for which the predicate is true. */
+static TextBufferObj count(TextBufferObj* args) {
+
+    TextBufferObj res;
+    size_t tested, passed;
+    if(testElems(args, STOP_NEVER, &tested, &passed)) {
+        res.type = OPT_INTEGER;
+        res.integer = passed;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
     return res;
 }
 
-/** Sign function. Returns +1 for +0 and -1 for -0. */
-static TextBufferObj sgn(TextBufferObj* args) {
+/** Returns whether the predicate is true for any element. */
+static TextBufferObj any(TextBufferObj* args) {
 
     TextBufferObj res;
-    if(args[0].type == OPT_NUMBER) {
+    size_t tested, passed;
+    if(testElems(args, STOP_ON_TRUE, &tested, &passed)) {
         res.type = OPT_INTEGER;
-        // (-inf, -0] -> -1 : [+0, inf) -> +1
-        res.integer = 1 - ((bool)signbit(args[0].number) << 1);
-    } else if(args[0].type == OPT_INTEGER) {
-        uint64_t a = args[0].integer;
+        res.integer = passed != 0;
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Returns whether the predicate is true for every element. */
+static TextBufferObj all(TextBufferObj* args) {
+
+    TextBufferObj res;
+    size_t tested, passed;
+    if(testElems(args, STOP_ON_FALSE, &tested, &passed)) {
         res.type = OPT_INTEGER;
-        //[min, -1] -> -1, [0] -> 0, [1, max] -> +1
-        res.integer = (a && (a < (UINT64_C(1) << 63))) - (a >> 63);
+        res.integer = passed == tested;
     } else {
         res.type = OPT_UNDEFINED;
     }
     return res;
 }
 
-//functional functions
+/**
+ * Compares two elements for sorting. Without a less than function,
+ * uses the total order of lv_blt_compare.
+ */
+static bool sortLess(TextBufferObj* func, TextBufferObj* a, TextBufferObj* b) {
 
-/** Functional map */
-static TextBufferObj map(TextBufferObj* args) {
+    if(!func)
+        return lv_blt_compare(a, b) < 0;
+    TextBufferObj args[2] = { *a, *b };
+    TextBufferObj res;
+    lv_callFunction(func, 2, args, &res);
+    incRefCount(&res);
+    bool less = lv_blt_toBool(&res);
+    lv_expr_cleanup(&res, 1);
+    return less;
+}
+
+#define INSERTION_SORT_MAX 16
+
+/** Stable merge sort of elems, using tmp as scratch space. */
+static void mergeSort(TextBufferObj* elems, TextBufferObj* tmp, size_t len, TextBufferObj* func) {
+
+    if(len <= INSERTION_SORT_MAX) {
+        for(size_t i = 1; i < len; i++) {
+            TextBufferObj elem = elems[i];
+            size_t j = i;
+            for(; j > 0 && sortLess(func, &elem, &elems[j - 1]); j--)
+                elems[j] = elems[j - 1];
+            elems[j] = elem;
+        }
+        return;
+    }
+    size_t mid = len / 2;
+    mergeSort(elems, tmp, mid, func);
+    mergeSort(elems + mid, tmp, len - mid, func);
+    //the halves may already be in order
+    if(!sortLess(func, &elems[mid], &elems[mid - 1]))
+        return;
+    memcpy(tmp, elems, mid * sizeof(TextBufferObj));
+    size_t i = 0, j = mid, k = 0;
+    while(i < mid && j < len) {
+        //take from the right only if strictly less, for stability
+        if(sortLess(func, &elems[j], &tmp[i])) {
+            elems[k++] = elems[j++];
+        } else {
+            elems[k++] = tmp[i++];
+        }
+    }
+    memcpy(&elems[k], &tmp[i], (mid - i) * sizeof(TextBufferObj));
+}
+
+/**
+ * Returns a sorted copy of the vect according to the less than
+ * function, or lv_blt_compare if func is NULL.
+ */
+static LvVect* sortVect(LvVect* src, TextBufferObj* func) {
+
+    LvVect* vect = lv_alloc(sizeof(LvVect) + src->len * sizeof(TextBufferObj));
+    vect->refCount = 0;
+    vect->hash = 0;
+    vect->len = src->len;
+    vect->tree = NULL;
+    vect->packed = OPT_UNDEFINED;
+    lv_vect_copy(src, vect->data);
+    for(size_t i = 0; i < vect->len; i++)
+        incRefCount(&vect->data[i]);
+    TextBufferObj* tmp = lv_alloc((vect->len / 2 + 1) * sizeof(TextBufferObj));
+    mergeSort(vect->data, tmp, vect->len, func);
+    lv_free(tmp);
+    return packIfLong(vect);
+}
+
+/**
+ * Sorts a vect in ascending order by sys:__lt__, with NaN after every
+ * other number. Long vects of only numbers or only ints are radix
+ * sorted. Returns undefined if an element is a function, since objects
+ * may define their own order.
+ */
+static TextBufferObj sort(TextBufferObj* args) {
 
     TextBufferObj res;
-    if(args[0].type == OPT_VECT) {
-        TextBufferObj func = args[1]; //in case the stack is reallocated
-        TextBufferObj* oldData = args[0].vect->data;
-        size_t len = args[0].vect->len;
-        LvVect* vect = lv_alloc(sizeof(LvVect) + len * sizeof(TextBufferObj));
-        vect->refCount = 0;
-        vect->len = len;
-        for(size_t i = 0; i < len; i++) {
-            TextBufferObj obj;
-            lv_callFunction(&func, 1, &oldData[i], &obj);
-            incRefCount(&obj);
-            vect->data[i] = obj;
+    res.type = OPT_UNDEFINED;
+    if(args[0].type != OPT_VECT)
+        return res;
+    LvVect* src = args[0].vect;
+    LvVect* packed = NULL;
+    if(src->len >= LV_VECT_PACK_MIN) {
+        if(!src->tree && src->packed != OPT_UNDEFINED) {
+            packed = lv_vect_newPacked(src->packed, src->len);
+            memcpy(packed->data, src->data, src->len * sizeof(double));
+        } else {
+            packed = lv_vect_pack(src);
+        }
+    }
+    if(packed) {
+        if(packed->packed == OPT_NUMBER) {
+            lv_kernel_sortNumbers(lv_vect_numbers(packed), packed->len);
+        } else {
+            lv_kernel_sortIntegers(lv_vect_integers(packed), packed->len);
         }
         res.type = OPT_VECT;
-        res.vect = vect;
-    } else {
-        res.type = OPT_UNDEFINED;
+        res.vect = packed;
+        return res;
+    }
+    for(size_t i = 0; i < src->len; i++) {
+        OpType type = lv_vect_get(src, i).type;
+        if(type == OPT_FUNCTION_VAL || type == OPT_CAPTURE)
+            return res;
     }
+    res.type = OPT_VECT;
+    res.vect = sortVect(src, NULL);
     return res;
 }
 
-/** Functional filter */
-static TextBufferObj filter(TextBufferObj* args) {
+/** Stably sorts a vect according to the given less than function. */
+static TextBufferObj sortBy(TextBufferObj* args) {
 
     TextBufferObj res;
     if(args[0].type == OPT_VECT) {
         TextBufferObj func = args[1];
-        TextBufferObj* oldData = args[0].vect->data;
-        size_t len = args[0].vect->len;
-        LvVect* vect = lv_alloc(sizeof(LvVect) + len * sizeof(TextBufferObj));
-        vect->refCount = 0;
-        size_t newLen = 0;
-        for(size_t i = 0; i < len; i++) {
-            TextBufferObj passed;
-            lv_callFunction(&func, 1, &oldData[i], &passed);
-            incRefCount(&passed); //so lv_expr_cleanup doesn't blow up
-            if(lv_blt_toBool(&passed)) {
-                incRefCount(&oldData[i]);
-                vect->data[newLen] = oldData[i];
-                newLen++;
-            }
-            lv_expr_cleanup(&passed, 1);
-        }
-        vect->len = newLen;
-        vect = lv_realloc(vect, sizeof(LvVect) + newLen * sizeof(TextBufferObj));
         res.type = OPT_VECT;
-        res.vect = vect;
+        res.vect = sortVect(args[0].vect, &func);
     } else {
         res.type = OPT_UNDEFINED;
     }
     return res;
 }
 
-/** Functional fold */
-static TextBufferObj fold(TextBufferObj* args) {
+/**
+ * Binary searches a sorted vect for elem, returning its index, or
+ * -idx - 1 where idx is where it would be inserted.
+ */
+static TextBufferObj binarySearch(LvVect* vect, TextBufferObj* elem, TextBufferObj* func) {
+
+    size_t lo = 0, hi = vect->len;
+    TextBufferObj res;
+    res.type = OPT_INTEGER;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        TextBufferObj val = lv_vect_get(vect, mid);
+        if(sortLess(func, elem, &val)) {
+            hi = mid;
+        } else if(sortLess(func, &val, elem)) {
+            lo = mid + 1;
+        } else {
+            res.integer = mid;
+            return res;
+        }
+    }
+    res.integer = -(uint64_t)lo - 1;
+    return res;
+}
+
+/** Binary searches a vect sorted by sys:sort. */
+static TextBufferObj bsearch_(TextBufferObj* args) {
 
     TextBufferObj res;
     if(args[0].type == OPT_VECT) {
-        size_t len = args[0].vect->len;
-        TextBufferObj* oldData = args[0].vect->data;
-        TextBufferObj accum[2] = { args[1] };
+        res = binarySearch(args[0].vect, &args[1], NULL);
+    } else {
+        res.type = OPT_UNDEFINED;
+    }
+    return res;
+}
+
+/** Binary searches a vect sorted by the given less than function. */
+static TextBufferObj bsearchBy(TextBufferObj* args) {
+
+    TextBufferObj res;
+    if(args[0].type == OPT_VECT) {
+        TextBufferObj elem = args[1];
         TextBufferObj func = args[2];
-        for(size_t i = 0; i < len; i++) {
-            accum[1] = oldData[i];
-            lv_callFunction(&func, 2, accum, &accum[0]);
-        }
-        res = accum[0];
+        res = binarySearch(args[0].vect, &elem, &func);
     } else {
         res.type = OPT_UNDEFINED;
     }
     return res;
 }
 
-/** Slices the given vect or string */
+/**
+ * Runs the stages of a fused chain from the given stage on for each
+ * element of src, without building the intermediate vects. The
+ * stage arguments begin at stageArgs.
+ */
+static TextBufferObj fuseVect(LvVect* src, uint64_t shape, int stage, TextBufferObj* stageArgs) {
+
+    int count = LV_FUSE_COUNT(shape);
+    bool folds = LV_FUSE_KIND(shape, count - 1) == FUSE_FOLD;
+    TextBufferObj res;
+    LvVect* vect = NULL;
+    if(folds) {
+        //the accumulator comes before the fold function
+        res = stageArgs[count - stage - 1];
+        incRefCount(&res);
+    } else {
+        vect = lv_alloc(sizeof(LvVect) + src->len * sizeof(TextBufferObj));
+        vect->refCount = 0;
+        vect->hash = 0;
+        vect->tree = NULL;
+        vect->packed = OPT_UNDEFINED;
+        vect->len = 0;
+    }
+    for(size_t i = 0; i < src->len; i++) {
+        TextBufferObj val = lv_vect_get(src, i);
+        incRefCount(&val);
+        bool passed = true;
+        for(int s = stage; passed && s < count; s++) {
+            TextBufferObj* func = &stageArgs[s - stage];
+            TextBufferObj tmp;
+            switch(LV_FUSE_KIND(shape, s)) {
+                case FUSE_MAP:
+                    lv_callFunction(func, 1, &val, &tmp);
+                    incRefCount(&tmp);
+                    lv_expr_cleanup(&val, 1);
+                    val = tmp;
+                    break;
+                case FUSE_FILTER:
+                    lv_callFunction(func, 1, &val, &tmp);
+                    incRefCount(&tmp);
+                    passed = lv_blt_toBool(&tmp);
+                    lv_expr_cleanup(&tmp, 1);
+                    break;
+                case FUSE_FOLD: {
+                    TextBufferObj accum[2] = { res, val };
+                    lv_callFunction(func + 1, 2, accum, &tmp);
+                    incRefCount(&tmp);
+                    lv_expr_cleanup(&res, 1);
+                    res = tmp;
+                    break;
+                }
+            }
+        }
+        if(passed && !folds) {
+            vect->data[vect->len++] = val;
+        } else {
+            lv_expr_cleanup(&val, 1);
+        }
+    }
+    if(folds) {
+        //return the accumulator unowned
+        if(res.type & LV_DYNAMIC)
+            --*res.refCount;
+    } else {
+        vect = lv_realloc(vect, sizeof(LvVect) + vect->len * sizeof(TextBufferObj));
+        res.type = OPT_VECT;
+        res.vect = packIfLong(vect);
+    }
+    return res;
+}
+
+static char* fuseStageNames[] = { "global:map", "global:filter", "global:fold" };
+
+/**
+ * Runs a fused chain of map, filter, and fold calls. Stages applied
+ * to values other than vects go through the generic global functions,
+ * so object-like receivers keep their own behavior.
+ */
+static TextBufferObj fuse(TextBufferObj* args) {
+
+    uint64_t shape = args[0].integer;
+    int count = LV_FUSE_COUNT(shape);
+    int numArgs = count + (LV_FUSE_KIND(shape, count - 1) == FUSE_FOLD);
+    //in case the stack is reallocated
+    TextBufferObj stageArgs[numArgs];
+    memcpy(stageArgs, &args[2], numArgs * sizeof(TextBufferObj));
+    TextBufferObj obj = args[1];
+    incRefCount(&obj);
+    int stage = 0;
+    TextBufferObj* argp = stageArgs;
+    for(; stage < count && obj.type != OPT_VECT; stage++) {
+        FuseKind kind = LV_FUSE_KIND(shape, stage);
+        TextBufferObj callArgs[3] = { obj, argp[0] };
+        if(kind == FUSE_FOLD)
+            callArgs[2] = argp[1];
+        TextBufferObj func = {
+            .type = OPT_FUNCTION_VAL,
+            .func = lv_op_getOperator(fuseStageNames[kind], FNS_INFIX)
+        };
+        TextBufferObj tmp;
+        int stageArity = kind == FUSE_FOLD ? 2 : 1;
+        lv_callFunction(&func, stageArity + 1, callArgs, &tmp);
+        incRefCount(&tmp);
+        lv_expr_cleanup(&obj, 1);
+        obj = tmp;
+        argp += stageArity;
+    }
+    if(stage < count) {
+        TextBufferObj res = fuseVect(obj.vect, shape, stage, argp);
+        //res may share elements with obj
+        incRefCount(&res);
+        lv_expr_cleanup(&obj, 1);
+        obj = res;
+    }
+    //return the result unowned
+    if(obj.type & LV_DYNAMIC)
+        --*obj.refCount;
+    return obj;
+}
+
+static Operator* fusedOperators[LV_FUSE_MAX_ARITY + 1];
+
+bool lv_blt_isFusedOperator(Operator* func) {
+
+    return func->type == FUN_BUILTIN && func->builtin == fuse;
+}
+
+Operator* lv_blt_fusedOperator(int arity) {
+
+    assert(arity <= LV_FUSE_MAX_ARITY);
+    if(!fusedOperators[arity]) {
+        Operator* op = lv_alloc(sizeof(Operator));
+        memset(op, 0, sizeof(Operator));
+        op->name = "sys:__fuse__";
+        op->type = FUN_BUILTIN;
+        op->arity = arity;
+        op->fixing = FIX_PRE;
+        op->builtin = fuse;
+        fusedOperators[arity] = op;
+    }
+    return fusedOperators[arity];
+}
+
+int lv_blt_fuseKind(Operator* func) {
+
+    for(int i = 0; i < 3; i++) {
+        if(func->fixing != FIX_PRE
+            && func->arity == (i == FUSE_FOLD ? 3 : 2)
+            && strcmp(func->name, fuseStageNames[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/** Slices the given vect, string, range, or sequence */
 static TextBufferObj slice(TextBufferObj* args) {
 
     TextBufferObj res;
     if(args[1].type != OPT_INTEGER || args[2].type != OPT_INTEGER) {
         //check that index args are numbers
         res.type = OPT_UNDEFINED;
-    } else if(args[0].type != OPT_VECT && args[0].type != OPT_STRING) {
+    } else if(args[0].type != OPT_VECT && args[0].type != OPT_STRING
+        && args[0].type != OPT_SEQ && args[0].type != OPT_RANGE) {
         //check that the receiver is of appropriate type
         res.type = OPT_UNDEFINED;
     } else {
@@ -990,22 +3341,27 @@ static TextBufferObj slice(TextBufferObj* args) {
         //sanity check
         if(start > end || isNegative(start) || isNegative(end)) {
             res.type = OPT_UNDEFINED;
+        } else if(args[0].type == OPT_SEQ) {
+            //sequences have no length to check against
+            res.type = OPT_SEQ;
+            res.seq = lv_seq_slice(args[0].seq, start, end, true);
         } else if(args[0].type == OPT_VECT) {
             size_t len = args[0].vect->len;
             //bounds check
             if((size_t)start > len || (size_t)end > len) {
                 res.type = OPT_UNDEFINED;
             } else {
-                //create new vect
                 res.type = OPT_VECT;
-                res.vect = lv_alloc(sizeof(LvVect) + (end - start) * sizeof(TextBufferObj));
-                res.vect->refCount = 0;
-                res.vect->len = end - start;
-                //copy over elements
-                for(size_t i = 0; i < res.vect->len; i++) {
-                    res.vect->data[i] = args[0].vect->data[start + i];
-                    incRefCount(&res.vect->data[i]);
-                }
+                res.vect = lv_vect_slice(args[0].vect, start, end);
+            }
+        } else if(args[0].type == OPT_RANGE) {
+            size_t len = args[0].range->len;
+            //bounds check
+            if((size_t)start > len || (size_t)end > len) {
+                res.type = OPT_UNDEFINED;
+            } else {
+                res.type = OPT_RANGE;
+                res.range = lv_range_slice(args[0].range, start, end);
             }
         } else if(args[0].type == OPT_STRING) {
             size_t len = args[0].str->len;
@@ -1017,6 +3373,7 @@ static TextBufferObj slice(TextBufferObj* args) {
                 res.type = OPT_STRING;
                 res.str = lv_alloc(sizeof(LvString) + (end - start + 1));
                 res.str->refCount = 0;
+                res.str->hash = 0;
                 res.str->len = end - start;
                 //copy over elements
                 memcpy(res.str->value, &args[0].str->value[start], res.str->len);
@@ -1040,6 +3397,7 @@ void lv_blt_onStartup(void) {
 
     #define SYS "sys:"
     #define MATH "math:"
+    #define GEN "generator:"
     #define MK_FUNCT(s, f) lv_tbl_put(&intrinsics, s#f, f)
     #define MK_FUNCN(s, f) lv_tbl_put(&intrinsics, s"__"#f"__", f)
     #define MK_FUNCR(s, f) lv_tbl_put(&intrinsics, s#f, f##_)
@@ -1049,12 +3407,82 @@ void lv_blt_onStartup(void) {
     MK_FUNCT(SYS, defined);
     MK_FUNCT(SYS, undefined);
     MK_FUNCR(SYS, typeof);
+    MK_FUNCT(SYS, isObject);
     MK_FUNCN(SYS, str);
     MK_FUNCN(SYS, num);
     MK_FUNNR(SYS, int);
     MK_FUNCT(SYS, cval);
     MK_FUNCT(SYS, cat);
     MK_FUNCT(SYS, call);
+    MK_FUNCT(SYS, update);
+    MK_FUNCT(SYS, pack);
+    MK_FUNCT(SYS, vadd);
+    MK_FUNCT(SYS, vsub);
+    MK_FUNCT(SYS, vmul);
+    MK_FUNCT(SYS, vdiv);
+    MK_FUNCT(SYS, vmin);
+    MK_FUNCT(SYS, vmax);
+    MK_FUNCT(SYS, vlt);
+    MK_FUNCT(SYS, vle);
+    MK_FUNCT(SYS, veq);
+    MK_FUNCT(SYS, vnum);
+    MK_FUNCT(SYS, vint);
+    MK_FUNCT(SYS, hash);
+    MK_FUNCT(SYS, emptyMap);
+    MK_FUNCT(SYS, mapGet);
+    MK_FUNCT(SYS, mapHas);
+    MK_FUNCT(SYS, mapAssoc);
+    MK_FUNCT(SYS, mapDissoc);
+    MK_FUNCT(SYS, mapMerge);
+    MK_FUNCT(SYS, mapKeys);
+    MK_FUNCT(SYS, emptySortedMap);
+    MK_FUNCT(SYS, emptySortedSet);
+    MK_FUNCT(SYS, sortedGet);
+    MK_FUNCT(SYS, sortedHas);
+    MK_FUNCT(SYS, sortedAssoc);
+    MK_FUNCT(SYS, sortedDissoc);
+    MK_FUNCT(SYS, sortedFloor);
+    MK_FUNCT(SYS, sortedCeiling);
+    MK_FUNCT(SYS, sortedRank);
+    MK_FUNCT(SYS, sortedAt);
+    MK_FUNCT(SYS, sortedFoldRange);
+    MK_FUNCT(SYS, emptyList);
+    MK_FUNCT(SYS, cons);
+    MK_FUNCT(SYS, listHead);
+    MK_FUNCT(SYS, listTail);
+    MK_FUNCT(SYS, listReverse);
+    MK_FUNCT(SYS, listHas);
+    MK_FUNCT(SYS, listToVect);
+    MK_FUNCT(SYS, listFlatten);
+    MK_FUNCT(SYS, range);
+    MK_FUNCT(SYS, rangeStart);
+    MK_FUNCT(SYS, rangeStop);
+    MK_FUNCT(SYS, rangeStep);
+    MK_FUNCT(SYS, rangeHas);
+    MK_FUNCT(SYS, seqOf);
+    MK_FUNCT(SYS, seqRange);
+    MK_FUNCT(SYS, seqIterate);
+    MK_FUNCT(SYS, seqWhile);
+    MK_FUNCT(SYS, seqFlatmap);
+    MK_FUNCT(SYS, seqZip);
+    MK_FUNCT(SYS, seqToVect);
+    MK_FUNCT(SYS, coroutine);
+    MK_FUNCT(SYS, coLoop);
+    MK_FUNCT(SYS, coResume);
+    MK_FUNCT(SYS, coYield);
+    MK_FUNCT(SYS, coDone);
+    MK_FUNCT(SYS, coValue);
+    MK_FUNCT(SYS, sum);
+    MK_FUNCT(SYS, product);
+    MK_FUNCT(SYS, minimum);
+    MK_FUNCT(SYS, maximum);
+    MK_FUNCT(SYS, count);
+    MK_FUNCT(SYS, any);
+    MK_FUNCT(SYS, all);
+    MK_FUNCT(SYS, sort);
+    MK_FUNCT(SYS, sortBy);
+    MK_FUNCR(SYS, bsearch);
+    MK_FUNCT(SYS, bsearchBy);
     MK_FUNCN(SYS, at);
     MK_FUNNR(SYS, bool);
     MK_FUNCN(SYS, eq);
@@ -1075,6 +3503,14 @@ void lv_blt_onStartup(void) {
     MK_FUNCN(SYS, fold);
     MK_FUNCN(SYS, slice);
     MK_FUNCN(SYS, concat);
+    MK_FUNCN(SYS, addInt);
+    MK_FUNCN(SYS, subInt);
+    MK_FUNCN(SYS, mulInt);
+    MK_FUNCN(SYS, ltInt);
+    MK_FUNCN(SYS, geInt);
+    MK_FUNCN(SYS, eqInt);
+    MK_FUNCN(SYS, vectLen);
+    MK_FUNCN(SYS, vectAt);
     MK_FUNCR(MATH, sin);
     MK_FUNCR(MATH, cos);
     MK_FUNCR(MATH, tan);
@@ -1094,10 +3530,13 @@ void lv_blt_onStartup(void) {
     MK_FUNCR(MATH, abs);
     MK_FUNCR(MATH, round);
     MK_FUNCT(MATH, sgn);
+    MK_FUNCR(GEN, next);
+    MK_FUNCR(GEN, seed);
     #undef MK_FUNNR
     #undef MK_FUNCR
     #undef MK_FUNCN
     #undef MK_FUNCT
+    #undef GEN
     #undef MATH
     #undef SYS
 }
@@ -1108,4 +3547,6 @@ void lv_blt_onShutdown(void) {
     lv_free(intrinsics.table);
     for(int i = 0; i < NUM_TYPES; i++)
         lv_free(types[i]);
+    for(int i = 0; i <= LV_FUSE_MAX_ARITY; i++)
+        lv_free(fusedOperators[i]);
 }
@@ -1,10 +1,70 @@
 #ifndef BUILTIN_H
 #define BUILTIN_H
 #include "textbuffer_fwd.h"
+#include <stddef.h>
+#include <stdint.h>
 
 typedef TextBufferObj (*Builtin)(TextBufferObj*);
 
 bool lv_blt_toBool(TextBufferObj* obj);
+
+/**
+ * Returns the structural hash of the given object. Hashes of strings,
+ * vects, and captures are cached in the object once computed.
+ * The result is never 0.
+ */
+size_t lv_blt_hash(TextBufferObj* obj);
+
+/** Returns whether the objects are equal, as sys:__eq__. */
+bool lv_blt_equal(TextBufferObj* a, TextBufferObj* b);
+
+/**
+ * Compares the objects in the order of sys:__lt__, returning a
+ * negative, zero, or positive value. Unlike sys:__lt__, NaN is
+ * ordered (after every other number), so the order is total.
+ */
+int lv_blt_compare(TextBufferObj* a, TextBufferObj* b);
+
+/**
+ * Returns whether the value of the given function (without
+ * captures) is object-like. The result is cached in the function.
+ */
+bool lv_blt_isObjectFunc(Operator* func);
+
+/**
+ * A fused call runs a chain of map, filter, and fold calls as one
+ * loop. It takes an integer describing the chain, the receiver, and
+ * then the args of each stage. The low byte of the integer is the
+ * number of stages and each following pair of bits is the kind of a
+ * stage. Only the last stage may be a fold.
+ */
+typedef enum FuseKind {
+    FUSE_MAP,
+    FUSE_FILTER,
+    FUSE_FOLD
+} FuseKind;
+
+#define LV_FUSE_MAX_STAGES 16
+#define LV_FUSE_MAX_ARITY (LV_FUSE_MAX_STAGES + 3)
+#define LV_FUSE_COUNT(shape) ((int)((shape) & 0xff))
+#define LV_FUSE_KIND(shape, i) ((FuseKind)(((shape) >> (8 + 2 * (i))) & 3))
+#define LV_FUSE_ADD(shape, kind) \
+    (((shape) + 1) | ((uint64_t)(kind) << (8 + 2 * LV_FUSE_COUNT(shape))))
+
+/**
+ * Returns the kind of stage a call to the given function is,
+ * or -1 if it is not the global map, filter, or fold.
+ */
+int lv_blt_fuseKind(Operator* func);
+/** Returns the fused call operator with the given arity. */
+Operator* lv_blt_fusedOperator(int arity);
+bool lv_blt_isFusedOperator(Operator* func);
+/**
+ * Returns whether the builtin may change its first argument in place
+ * when it holds the only reference to it, which is only safe when
+ * the argument is pushed for the call.
+ */
+bool lv_blt_isInPlace(Operator* func);
 Builtin lv_blt_getIntrinsic(char* name);
 
 void lv_blt_onStartup(void);
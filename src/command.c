@@ -2,8 +2,11 @@
 #include "lavender.h"
 #include "operator.h"
 #include "hashtable.h"
+#include "memo.h"
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
 
 typedef struct CommandElement {
     char* name;
@@ -13,11 +16,13 @@ typedef struct CommandElement {
 static bool quit(Token* head);
 static bool import(Token* head);
 static bool using(Token* head);
+static bool memo(Token* head);
 
 static CommandElement COMMANDS[] = {
     { "quit", quit },
     { "import", import },
     { "using", using },
+    { "memo", memo },
 };
 #define NUM_COMMANDS (sizeof(COMMANDS) / sizeof(CommandElement))
 
@@ -197,3 +202,56 @@ static bool import(Token* head) {
         return false;
     }
 }
+
+#define DEFAULT_MEMO_CAPACITY 1024
+
+static bool memo(Token* head) {
+
+    head = head->next;
+    if(!head || (head->next && (head->next->type != TTY_INTEGER
+                                || head->next->next))) {
+        lv_cmd_message = "Usage: @memo <qualified name> [capacity]";
+        return false;
+    }
+    if(head->type != TTY_QUAL_IDENT && head->type != TTY_QUAL_SYMBOL) {
+        lv_cmd_message = "Error: not a valid name";
+        return false;
+    }
+    Operator* op = NULL;
+    for(FuncNamespace ns = 0; (ns < FNS_COUNT) && !op; ns++) {
+        op = lv_op_getOperator(head->value, ns);
+    }
+    if(!op) {
+        lv_cmd_message = "Error: name not found";
+        return false;
+    }
+    if(op->type != FUN_FUNCTION || op->byName) {
+        //by name params are not values that can be compared
+        lv_cmd_message = "Error: function cannot be memoized";
+        return false;
+    }
+    size_t capacity = DEFAULT_MEMO_CAPACITY;
+    if(head->next) {
+        errno = 0;
+        unsigned long long value = strtoull(head->next->value, NULL, 10);
+        if(errno == ERANGE || value > LV_MEMO_MAX_CAPACITY) {
+            lv_cmd_message = "Usage: @memo <qualified name> [capacity], "
+                "where capacity is at most 16777216";
+            return false;
+        }
+        capacity = (size_t)value;
+        if(capacity == 0) {
+            lv_cmd_message = "Error: capacity must be positive";
+            return false;
+        }
+    }
+    if(op->memo) {
+        //memoizing again changes the capacity
+        lv_memo_setCapacity(op->memo, capacity);
+        lv_cmd_message = "Memo capacity changed";
+    } else {
+        op->memo = lv_memo_new(op->name, capacity);
+        lv_cmd_message = "Memo successful";
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#include "coroutine.h"
+#include "lavender.h"
+#include "expression.h"
+#include <string.h>
+#include <assert.h>
+
+static void incRefCount(TextBufferObj* obj) {
+
+    if(obj->type & LV_DYNAMIC)
+        ++*obj->refCount;
+}
+
+LvCoroutine* lv_coroutine_new(TextBufferObj* func, bool loop) {
+
+    LvCoroutine* co = lv_alloc(sizeof(LvCoroutine));
+    co->refCount = 0;
+    co->state = CO_NEW;
+    co->func = *func;
+    incRefCount(&co->func);
+    co->value.type = OPT_UNDEFINED;
+    co->stack.data = NULL;
+    co->stack.cap = co->stack.len = 0;
+    co->stack.dataSize = sizeof(TextBufferObj);
+    co->pc = co->fp = 0;
+    co->depth = 0;
+    co->loop = loop;
+    co->yielded = false;
+    return co;
+}
+
+LvCoroutine* lv_coroutine_copy(LvCoroutine* co) {
+
+    if(co->state == CO_NEW)
+        return lv_coroutine_new(&co->func, co->loop);
+    if(co->state != CO_SUSPENDED)
+        return NULL;
+    LvCoroutine* res = lv_alloc(sizeof(LvCoroutine));
+    *res = *co;
+    res->refCount = 0;
+    incRefCount(&res->func);
+    incRefCount(&res->value);
+    //frame pointers and thunks index into the stack,
+    //so they are valid in the copy as they are
+    res->stack.data = lv_alloc(co->stack.cap * sizeof(TextBufferObj));
+    memcpy(res->stack.data, co->stack.data, co->stack.len * sizeof(TextBufferObj));
+    for(size_t i = 0; i < co->stack.len; i++)
+        incRefCount(lv_buf_get(&res->stack, i));
+    return res;
+}
+
+void lv_coroutine_free(LvCoroutine* co) {
+
+    assert(co->refCount == 0);
+    assert(co->state != CO_RUNNING);
+    lv_expr_cleanup(&co->func, 1);
+    lv_expr_cleanup(&co->value, 1);
+    if(co->stack.data) {
+        lv_expr_cleanup(co->stack.data, co->stack.len);
+        lv_free(co->stack.data);
+    }
+    lv_free(co);
+}
@@ -0,0 +1,60 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+#include "textbuffer.h"
+#include "dynbuffer.h"
+#include <stddef.h>
+
+/**
+ * Lavender coroutines are functions whose evaluation can be suspended
+ * and resumed. A coroutine runs on its own stack, so suspending it
+ * keeps its frames as they are, and resuming it continues where it
+ * left off without rebuilding any state. The VM side of resuming and
+ * yielding is in lavender.c.
+ *
+ * Coroutines are mutated by resuming them. They are only resumed in
+ * place by their only owner, such as an iteration over a sequence or
+ * a resume given the last reference to the coroutine. Coroutines that
+ * are shared are copied before they are resumed, so no other holder
+ * sees the change.
+ *
+ * A looping coroutine calls its function again with the result each
+ * time the function returns, so its state is carried from one call to
+ * the next. It is done once a call returns without yielding.
+ */
+
+typedef enum CoroutineState {
+    CO_NEW,         //not yet called
+    CO_SUSPENDED,   //stopped at a yield
+    CO_RUNNING,     //being resumed
+    CO_DONE,        //returned
+} CoroutineState;
+
+struct LvCoroutine {
+    size_t refCount;
+    CoroutineState state;
+    TextBufferObj func;     //body, until the coroutine starts unless it loops
+    TextBufferObj value;    //last value yielded or returned
+    DynBuffer stack;        //frames of a suspended coroutine
+    size_t pc;              //where a suspended coroutine resumes
+    size_t fp;
+    size_t depth;           //native call depth of the resume running it
+    bool loop;              //whether func is called again when it returns
+    bool yielded;           //whether the current call of func has yielded
+};
+
+/**
+ * Returns a new coroutine that calls func when it is first resumed,
+ * and again with each result if loop is true.
+ */
+LvCoroutine* lv_coroutine_new(TextBufferObj* func, bool loop);
+
+/**
+ * Returns a copy of a new or suspended coroutine, which can be resumed
+ * without affecting the original. Returns NULL for other coroutines.
+ */
+LvCoroutine* lv_coroutine_copy(LvCoroutine* co);
+
+/** Frees a coroutine whose refCount has reached 0. */
+void lv_coroutine_free(LvCoroutine* co);
+
+#endif
@@ -29,6 +29,7 @@ static void parseArity(void);
 static void parseLocals(Token* head); //called by parseArity
 static void parseNameAndFixing(void);
 static void setupArgsArray(Param params[]);
+static void findCaptures(Token* tok, Param params[], bool needed[]);
 static void buildFuncName(void);
 
 Operator* lv_expr_declareFunction(Token* tok, Operator* nspace, Token** bodyTok) {
@@ -79,12 +80,28 @@ Operator* lv_expr_declareFunction(Token* tok, Operator* nspace, Token** bodyTok)
         return NULL;
     }
     //holds the parameters (formal, captured, and local) and their names
-    int totalParams = context.arity + nspace->arity + nspace->locals + context.locals;
+    int enclosingParams = nspace->arity + nspace->locals;
+    int totalParams = context.arity + enclosingParams + context.locals;
     Param args[totalParams];
     //set up the args array
     setupArgsArray(args);
     if(LV_EXPR_ERROR)
         return NULL;
+    //capture the enclosing formals, and the enclosing locals this function uses
+    bool needed[enclosingParams + 1];
+    findCaptures(tok, args, needed);
+    int captureCount = 0;
+    int captures[enclosingParams + 1];
+    for(int i = 0; i < enclosingParams; i++) {
+        if(needed[i]) {
+            args[context.arity + captureCount] = args[context.arity + i];
+            captures[captureCount++] = i;
+        }
+    }
+    memmove(args + context.arity + captureCount,
+        args + context.arity + enclosingParams,
+        context.locals * sizeof(Param));
+    totalParams -= enclosingParams - captureCount;
     REQUIRE_MORE_TOKENS(context.head);
     if(strcmp(context.head->value, "=>") != 0) {
         //sorry, a function body is required
@@ -113,10 +130,30 @@ Operator* lv_expr_declareFunction(Token* tok, Operator* nspace, Token** bodyTok)
         funcObj->type = FUN_FWD_DECL;
         funcObj->arity = totalParams - context.locals;
         funcObj->fixing = context.fixing;
-        funcObj->captureCount = nspace->arity + nspace->locals;
+        funcObj->captureCount = captureCount;
+        funcObj->captures = NULL;
+        funcObj->enclosing = NULL;
+        if(captureCount > 0) {
+            funcObj->captures = lv_alloc(captureCount * sizeof(int));
+            memcpy(funcObj->captures, captures, captureCount * sizeof(int));
+            funcObj->enclosing = nspace;
+        }
         funcObj->locals = context.locals;
         funcObj->params = lv_alloc(totalParams * sizeof(Param));
         funcObj->varargs = context.varargs;
+        //only the first 64 formal params may be passed by name,
+        //any beyond that are passed by value
+        funcObj->byName = 0;
+        funcObj->strict = 0;
+        funcObj->objectLike = OBJ_UNKNOWN;
+        funcObj->generic = NULL;
+        funcObj->paramTypes = NULL;
+        funcObj->typedSpecs = 0;
+        funcObj->memo = NULL;
+        for(int i = 0; i < context.arity && i < 64; i++) {
+            if(args[i].byName)
+                funcObj->byName |= UINT64_C(1) << i;
+        }
         memcpy(funcObj->params, args, totalParams * sizeof(Param));
         //copy param names
         for(int i = 0; i < totalParams; i++) {
@@ -187,7 +224,8 @@ static void setupArgsArray(Param params[]) {
         assert(context.head->next->type == TTY_LITERAL);
         context.head = context.head->next->next; //skip comma or close paren
     }
-    //copy over captured params (if any)
+    //copy over enclosing params (if any), the unused
+    //params are removed in lv_expr_declareFunction
     memcpy(params + arity, context.nspace->params,
         (context.nspace->arity + context.nspace->locals) * sizeof(Param));
     int offset = arity + context.nspace->arity + context.nspace->locals;
@@ -225,6 +263,117 @@ static void setupArgsArray(Param params[]) {
     }
 }
 
+/**
+ * Marks the params of the enclosing function that are needed
+ * to pass the captured params of the given function.
+ */
+static void requireCaptures(Operator* func, bool needed[]) {
+
+    for(int i = 0; i < func->captureCount; i++) {
+        int param = lv_op_getCapturedParam(context.nspace,
+            func->enclosing, func->captures[i]);
+        if(param >= 0)
+            needed[param] = true;
+    }
+}
+
+/**
+ * Marks the params of the enclosing functions needed by a
+ * reference to the given function name.
+ */
+static void requireFunction(char* name, bool needed[]) {
+
+    //try each enclosing scope, like parseSymbolImpl
+    char* scope = context.nspace->name;
+    size_t slen = strlen(scope);
+    char fname[slen + strlen(name) + 2];
+    for(size_t i = 0; i <= slen; i++) {
+        if(scope[i] != ':' && scope[i] != '\0')
+            continue;
+        memcpy(fname, scope, i);
+        fname[i] = ':';
+        strcpy(fname + i + 1, name);
+        //change ':' in symbolic names to '#'
+        char* c = fname + i + 1;
+        while((c = strchr(c, ':')))
+            *c = '#';
+        for(FuncNamespace ns = 0; ns < FNS_COUNT; ns++) {
+            Operator* func = lv_op_getOperator(fname, ns);
+            if(func && func->captureCount > 0)
+                requireCaptures(func, needed);
+        }
+    }
+}
+
+/**
+ * Finds the params of the enclosing function that the function
+ * starting at tok captures. The formal params are always captured,
+ * so sys:cval can return any of them. The locals are captured if
+ * they are mentioned by name anywhere in the function (including in
+ * nested functions), or captured by other nested functions that are
+ * referenced.
+ */
+static void findCaptures(Token* tok, Param params[], bool needed[]) {
+
+    Operator* nspace = context.nspace;
+    int enclosingParams = nspace->arity + nspace->locals;
+    for(int i = 0; i < enclosingParams; i++) {
+        needed[i] = (i < nspace->arity);
+    }
+    if(enclosingParams == 0)
+        return;
+    bool grouped = (tok->type == TTY_LITERAL && tok->value[0] == '(');
+    int nesting = 0;
+    for(Token* head = tok; head; head = head->next) {
+        switch(head->type) {
+            case TTY_LITERAL:
+                switch(head->value[0]) {
+                    case '(':
+                    case '[':
+                    case '{': nesting++; break;
+                    case ')':
+                    case ']':
+                    case '}': nesting--; break;
+                }
+                break;
+            case TTY_IDENT: {
+                //formal params shadow enclosing params
+                bool shadowed = false;
+                for(int i = 0; i < context.arity && !shadowed; i++) {
+                    shadowed = (strcmp(head->value, params[i].name) == 0);
+                }
+                if(!shadowed) {
+                    for(int i = 0; i < enclosingParams; i++) {
+                        if(strcmp(head->value, nspace->params[i].name) == 0) {
+                            needed[i] = true;
+                            break;
+                        }
+                    }
+                }
+                requireFunction(head->value, needed);
+                break;
+            }
+            case TTY_SYMBOL:
+                requireFunction(head->value, needed);
+                break;
+            case TTY_FUNC_VAL: {
+                //skip the leading '\' and any trailing '\'
+                size_t len = strlen(head->value);
+                char name[len];
+                strcpy(name, head->value + 1);
+                if(len > 1 && name[len - 2] == '\\')
+                    name[len - 2] = '\0';
+                requireFunction(name, needed);
+                break;
+            }
+            default:
+                break;
+        }
+        if(nesting < 0 || (grouped && nesting == 0))
+            break;
+    }
+}
+
 static bool specifiesFixing(void) {
 
     switch(context.head->type) {
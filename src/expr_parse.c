@@ -2,6 +2,7 @@
 #include "lavender.h"
 #include "operator.h"
 #include "command.h"
+#include "builtin.h"
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -431,8 +432,9 @@ static void parseIdent(TextBufferObj* obj, ExprContext* cxt) {
         int numParams = cxt->decl->arity + cxt->decl->locals;
         for(int i = 0; i < numParams; i++) {
             if(strcmp(cxt->head->value, cxt->decl->params[i].name) == 0) {
-                //save param name
-                obj->type = OPT_PARAM;
+                //save param name, by name params may
+                //need to be evaluated on first use
+                obj->type = cxt->decl->params[i].byName ? OPT_FORCE : OPT_PARAM;
                 obj->param = i;
                 cxt->expectOperand = false;
                 return;
@@ -476,6 +478,7 @@ static void parseString(TextBufferObj* obj, ExprContext* cxt) {
     char* c = cxt->head->value + 1; //skip open quote
     LvString* newStr = lv_alloc(sizeof(LvString) + strlen(c) + 1);
     newStr->refCount = 1; //it will be added to the text buffer
+    newStr->hash = 0;
     size_t len = 0;
     while(*c != '"') {
         if(*c == '\\') {
@@ -604,6 +607,233 @@ static void fixArityFirstArg(ExprContext* cxt) {
     }
 }
 
+/**
+ * Returns the index of the first instruction of the value whose
+ * last instruction is at index end of the stack, or 0 if the
+ * code does not make up a single value.
+ */
+static size_t valueStart(TextStack* stack, size_t end) {
+
+    //the number of values we need to find the start of
+    int need = 1;
+    for(size_t i = end; i > 0; i--) {
+        TextBufferObj* obj = &stack->stack[i];
+        switch(obj->type) {
+            case OPT_UNDEFINED:
+            case OPT_NUMBER:
+            case OPT_INTEGER:
+            case OPT_PARAM:
+            case OPT_FORCE:
+            case OPT_FUNCTION_VAL:
+            case OPT_STRING:
+            case OPT_VECT:
+            case OPT_CAPTURE:
+                need--;
+                break;
+            case OPT_END_THUNK:
+                //skip to the matching OPT_MAKE_THUNK
+                i -= obj->branchAddr;
+                need--;
+                break;
+            case OPT_FUNCTION:
+                need += obj->func->arity - 1;
+                break;
+            case OPT_FUNC_CALL:
+                //callArity does not include the function
+                need += obj->callArity;
+                break;
+            case OPT_FUNC_CALL2:
+            case OPT_MAKE_VECT:
+                need += obj->callArity - 1;
+                break;
+            case OPT_FUNC_CAP:
+                //the function value directly precedes CAP
+                need += stack->stack[i - 1].func->captureCount;
+                break;
+            default:
+                return 0;
+        }
+        if(need == 0)
+            return i;
+    }
+    return 0;
+}
+
+/** Inserts obj into the stack at the given index. */
+static void insertStack(TextStack* stack, size_t idx, TextBufferObj* obj) {
+
+    //push a placeholder to make room
+    TextBufferObj tmp = { .type = OPT_UNDEFINED };
+    pushStack(stack, &tmp);
+    TextBufferObj* pos = stack->stack + idx;
+    memmove(pos + 1, pos, (stack->top - pos) * sizeof(TextBufferObj));
+    *pos = *obj;
+}
+
+/**
+ * Fuses a call to the global map, filter, or fold with the map and
+ * filter calls computing its receiver, so the chain runs as a single
+ * loop without building the intermediate vects. The ar args of func
+ * are on top of the out stack. Returns whether the call was fused,
+ * in which case the fused call has been pushed instead of func.
+ */
+static bool fuseStage(ExprContext* cxt, Operator* func, int ar) {
+
+    int kind = lv_blt_fuseKind(func);
+    if(lv_optLevel < 2 || kind < 0 || ar != func->arity)
+        return false;
+    //find the end of the receiver
+    size_t end = cxt->out.top - cxt->out.stack;
+    for(int i = 1; i < ar; i++) {
+        size_t start = valueStart(&cxt->out, end);
+        if(start == 0)
+            return false;
+        end = start - 1;
+    }
+    TextBufferObj* recv = &cxt->out.stack[end];
+    if(recv->type != OPT_FUNCTION)
+        return false;
+    size_t start = valueStart(&cxt->out, end);
+    if(start == 0)
+        return false;
+    int arity;
+    uint64_t shape;
+    int innerKind = lv_blt_fuseKind(recv->func);
+    if(innerKind == FUSE_MAP || innerKind == FUSE_FILTER) {
+        //start a new chain
+        arity = recv->func->arity + 1;
+        shape = LV_FUSE_ADD(UINT64_C(0), innerKind);
+        TextBufferObj obj = { .type = OPT_INTEGER, .integer = shape };
+        insertStack(&cxt->out, start, &obj);
+        end++;
+    } else if(lv_blt_isFusedOperator(recv->func)) {
+        //extend the chain unless it already ends in a fold
+        arity = recv->func->arity;
+        shape = cxt->out.stack[start].integer;
+        int count = LV_FUSE_COUNT(shape);
+        if(count == LV_FUSE_MAX_STAGES
+            || LV_FUSE_KIND(shape, count - 1) == FUSE_FOLD)
+            return false;
+    } else {
+        return false;
+    }
+    shape = LV_FUSE_ADD(shape, kind);
+    cxt->out.stack[start].integer = shape;
+    //remove the receiver's call and call the fused operator instead
+    TextBufferObj* pos = cxt->out.stack + end;
+    memmove(pos, pos + 1, (cxt->out.top - pos) * sizeof(TextBufferObj));
+    cxt->out.top--;
+    TextBufferObj obj = {
+        .type = OPT_FUNCTION,
+        .func = lv_blt_fusedOperator(arity + ar - 1)
+    };
+    pushStack(&cxt->out, &obj);
+    return true;
+}
+
+/**
+ * Passes the by name arguments to func lazily. The ar arguments
+ * are the values on top of the out stack. The code for each
+ * argument is placed between OPT_MAKE_THUNK and OPT_END_THUNK,
+ * so it is evaluated at most once, when func first uses it.
+ * Arguments func always evaluates and arguments that are cheap
+ * to evaluate are passed by value instead.
+ */
+static void delayArgs(ExprContext* cxt, Operator* func, int ar) {
+
+    size_t starts[ar];
+    size_t ends[ar];
+    size_t end = cxt->out.top - cxt->out.stack;
+    for(int i = ar - 1; i >= 0; i--) {
+        starts[i] = valueStart(&cxt->out, end);
+        if(starts[i] == 0)
+            return; //not something we understand, pass by value
+        ends[i] = end;
+        end = starts[i] - 1;
+    }
+    //go from the last argument so the earlier indices stay valid
+    for(int i = ar - 1; i >= 0; i--) {
+        if(i >= 64 || (func->varargs && i == ar - 1))
+            continue;
+        uint64_t bit = UINT64_C(1) << i;
+        if(!(func->byName & bit) || (func->strict & bit))
+            continue;
+        TextBufferObj* first = &cxt->out.stack[starts[i]];
+        if(starts[i] == ends[i]) {
+            if(first->type == OPT_FORCE) {
+                //pass our own by name param along unevaluated
+                first->type = OPT_PARAM;
+                continue;
+            }
+            //constants and params are cheaper than a thunk
+            if(first->type != OPT_FUNCTION)
+                continue;
+        }
+        int len = ends[i] - starts[i] + 1;
+        TextBufferObj obj = { .type = OPT_END_THUNK, .branchAddr = len + 1 };
+        insertStack(&cxt->out, ends[i] + 1, &obj);
+        obj.type = OPT_MAKE_THUNK;
+        obj.branchAddr = len + 2;
+        insertStack(&cxt->out, starts[i], &obj);
+    }
+}
+
+/**
+ * Compiles a call to a function value as a direct call when the
+ * function is known. The arity values on top of the out stack are
+ * the function followed by its args. Closures created just to be
+ * called (such as `(def impl(a) => ...)(x)`) never escape, so
+ * instead of allocating a capture we pass the captured params as
+ * extra args, like a call by name. Returns whether the call
+ * was compiled.
+ */
+static bool liftCall(ExprContext* cxt, int arity) {
+
+    size_t start = cxt->out.top - cxt->out.stack;
+    size_t end = start;
+    for(int i = 0; i < arity; i++) {
+        end = start;
+        start = valueStart(&cxt->out, end);
+        if(start == 0)
+            return false;
+        if(i < arity - 1)
+            start--;
+    }
+    //the function is either a value or a value with its captures
+    TextBufferObj* first = &cxt->out.stack[start];
+    TextBufferObj* val = &cxt->out.stack[end];
+    int caps = 0;
+    if(val->type == OPT_FUNC_CAP) {
+        val--;
+        caps = val - first;
+        if(val->type != OPT_FUNCTION_VAL || val->func->captureCount != caps)
+            return false;
+    } else if(val != first
+        || val->type != OPT_FUNCTION_VAL
+        || val->func->captureCount > 0) {
+        return false;
+    }
+    Operator* func = val->func;
+    if(func->varargs || (func->arity - func->captureCount) != arity - 1)
+        return false;
+    //move the args down over the function value
+    TextBufferObj capture[caps + 1];
+    memcpy(capture, first, caps * sizeof(TextBufferObj));
+    TextBufferObj* args = val + (caps > 0 ? 2 : 1);
+    size_t len = (cxt->out.top - args) + 1;
+    memmove(first, args, len * sizeof(TextBufferObj));
+    cxt->out.top = first + len - 1;
+    //by name params work as usual
+    if(func->byName & ~func->strict)
+        delayArgs(cxt, func, arity - 1);
+    for(int i = 0; i < caps; i++) {
+        pushStack(&cxt->out, &capture[i]);
+    }
+    TextBufferObj call = { .type = OPT_FUNCTION, .func = func };
+    pushStack(&cxt->out, &call);
+    return true;
+}
+
 //shunts over one op (or handles right bracket)
 //optionally removing the top operator
 //and checks function arity if applicable.
@@ -637,15 +867,27 @@ static bool shuntOps(ExprContext* cxt) {
                 ar = tmp->func->arity;
                 pushStack(&cxt->out, &obj);
             }
+            //delay by name args (the args are all on out)
+            if((tmp->func->byName & ~tmp->func->strict)
+                && (tmp->func->arity - tmp->func->captureCount) == ar) {
+                delayArgs(cxt, tmp->func, ar);
+            }
             //push any extra implicit capture args
-            for(int i = tmp->func->captureCount; i > 0; i--) {
+            for(int i = 0; i < tmp->func->captureCount; i++) {
                 TextBufferObj obj;
                 obj.type = OPT_PARAM;
-                obj.param = cxt->decl->arity - i;
+                obj.param = lv_op_getCapturedParam(cxt->decl,
+                    tmp->func->enclosing, tmp->func->captures[i]);
+                if(obj.param < 0) {
+                    LV_EXPR_ERROR = XPE_NAME_NOT_FOUND;
+                    pushStack(&cxt->ops, tmp);
+                    return false;
+                }
                 pushStack(&cxt->out, &obj);
             }
             fixArityFirstArg(cxt);
-            pushStack(&cxt->out, tmp);
+            if(!fuseStage(cxt, tmp->func, ar))
+                pushStack(&cxt->out, tmp);
             if((tmp->func->arity - tmp->func->captureCount) != ar) {
                 LV_EXPR_ERROR = XPE_BAD_ARITY;
                 return false;
@@ -655,7 +897,7 @@ static bool shuntOps(ExprContext* cxt) {
             int ar = *cxt->params.top--;
             if(ar < 0) {
                 LV_EXPR_ERROR = XPE_BAD_ARITY;
-            } else {
+            } else if(!liftCall(cxt, ar)) {
                 tmp->callArity = ar;
                 pushStack(&cxt->out, tmp);
             }
@@ -810,13 +1052,18 @@ static void shuntingYard(TextBufferObj* obj, ExprContext* cxt) {
     } else if(obj->type == OPT_FUNCTION_VAL && obj->func->captureCount > 0) {
         //push capture params onto stack, then push obj, then push CAP
         //out: ... cap1 cap2 .. capn obj CAP ...
-        //self capture does not capture locals
-        int ar = (obj->func == cxt->decl) ? cxt->decl->arity
-            : (cxt->decl->arity + cxt->decl->locals);
-        for(int i = obj->func->captureCount; i > 0; i--) {
+        Operator* func = obj->func;
+        for(int i = 0; i < func->captureCount; i++) {
+            int param = lv_op_getCapturedParam(cxt->decl,
+                func->enclosing, func->captures[i]);
+            if(param < 0) {
+                LV_EXPR_ERROR = XPE_NAME_NOT_FOUND;
+                return;
+            }
+            //by name params are evaluated before they are captured
             TextBufferObj obj;
-            obj.type = OPT_PARAM;
-            obj.param = ar - i;
+            obj.type = cxt->decl->params[param].byName ? OPT_FORCE : OPT_PARAM;
+            obj.param = param;
             pushStack(&cxt->out, &obj);
         }
         pushStack(&cxt->out, obj);
@@ -843,7 +1090,8 @@ static void shuntingYard(TextBufferObj* obj, ExprContext* cxt) {
             //zero arity version
             //push directly to out, since there are no args
             obj->callArity = 1;
-            pushStack(&cxt->out, obj);
+            if(!liftCall(cxt, 1))
+                pushStack(&cxt->out, obj);
             //no need to push param because it's already on out
         }
     } else if(obj->type != OPT_FUNCTION || obj->func->arity == 0) {
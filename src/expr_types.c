@@ -0,0 +1,483 @@
+#include "expression.h"
+#include "textbuffer.h"
+#include "operator.h"
+#include "dynbuffer.h"
+#include "lavender.h"
+#include <string.h>
+
+/**
+ * A set of the dynamic types a value may have at runtime.
+ * The type inference pass tracks these for each param and
+ * for each value on the operand stack.
+ */
+typedef unsigned TypeSet;
+#define TY_UNDEFINED    0x01
+#define TY_NUMBER       0x02
+#define TY_INTEGER      0x04
+#define TY_STRING       0x08
+#define TY_VECT         0x10
+#define TY_FUNCTION     0x20
+#define TY_MAP          0x40
+#define TY_SORTED       0x80
+#define TY_LIST         0x100
+#define TY_SEQ          0x200
+#define TY_RANGE        0x400
+#define TY_COROUTINE    0x800
+#define TY_NUMERIC      (TY_NUMBER | TY_INTEGER)
+//values that can never be object-like
+#define TY_PRIMITIVE    (TY_UNDEFINED | TY_NUMERIC | TY_STRING | TY_VECT | TY_MAP | TY_SORTED | TY_LIST | TY_SEQ | TY_RANGE | TY_COROUTINE)
+#define TY_ANY          (TY_PRIMITIVE | TY_FUNCTION)
+
+#define SUBSET(a, b) (((a) & ~(b)) == 0)
+
+/**
+ * The global operators only forward to an object if the
+ * operands are object-like. When the types of the operands
+ * are known not to be, the operator is the same as the
+ * intrinsic it falls back to.
+ */
+static const struct Specialization {
+    char* name;         //generic operator
+    int arity;
+    char* intrinsic;    //intrinsic to call directly
+} specializations[] = {
+    { "global:=",       2, "sys:__eq__" },
+    { "global:<",       2, "sys:__lt__" },
+    { "global:>=",      2, "sys:__ge__" },
+    { "global:+",       2, "sys:__add__" },
+    { "global:-",       2, "sys:__sub__" },
+    { "global:*",       2, "sys:__mul__" },
+    { "global:/",       2, "sys:__div__" },
+    { "global://",      2, "sys:__idiv__" },
+    { "global:%",       2, "sys:__rem__" },
+    { "global:**",      2, "sys:__pow__" },
+    { "global:+",       1, "sys:__pos__" },
+    { "global:-",       1, "sys:__neg__" },
+    { "global:str",     1, "sys:__str__" },
+    { "global:num",     1, "sys:__num__" },
+    { "global:int",     1, "sys:__int__" },
+    { "global:bool",    1, "sys:__bool__" },
+    { "global:len",     1, "sys:__len__" },
+};
+#define NUM_SPECIALIZATIONS (sizeof(specializations) / sizeof(specializations[0]))
+
+/**
+ * Returns the builtin with the given name, or NULL if there is none.
+ */
+static Operator* getBuiltin(char* name) {
+
+    Operator* res = lv_op_getOperator(name, FNS_PREFIX);
+    return (res && res->type == FUN_BUILTIN) ? res : NULL;
+}
+
+/**
+ * Returns the intrinsic the given generic operator may be
+ * replaced with, or NULL if there is none.
+ */
+static Operator* getSpecialization(Operator* func) {
+
+    for(size_t i = 0; i < NUM_SPECIALIZATIONS; i++) {
+        const struct Specialization* spec = &specializations[i];
+        if(func->arity == spec->arity && strcmp(func->name, spec->name) == 0) {
+            return getBuiltin(spec->intrinsic);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Intrinsics with unchecked versions, which may be called instead
+ * when the operands are known to have the given types.
+ */
+static const struct Unchecked {
+    char* name;         //checked intrinsic
+    TypeSet types[2];   //types the operands must have
+    char* unchecked;    //intrinsic to call instead
+} uncheckedOps[] = {
+    { "sys:__add__",    { TY_INTEGER, TY_INTEGER }, "sys:__addInt__" },
+    { "sys:__sub__",    { TY_INTEGER, TY_INTEGER }, "sys:__subInt__" },
+    { "sys:__mul__",    { TY_INTEGER, TY_INTEGER }, "sys:__mulInt__" },
+    { "sys:__lt__",     { TY_INTEGER, TY_INTEGER }, "sys:__ltInt__" },
+    { "sys:__ge__",     { TY_INTEGER, TY_INTEGER }, "sys:__geInt__" },
+    { "sys:__eq__",     { TY_INTEGER, TY_INTEGER }, "sys:__eqInt__" },
+    { "sys:__len__",    { TY_VECT },                "sys:__vectLen__" },
+};
+#define NUM_UNCHECKED (sizeof(uncheckedOps) / sizeof(uncheckedOps[0]))
+
+/**
+ * Returns the unchecked version of the given intrinsic for operands
+ * of the given types, or NULL if there is none.
+ */
+static Operator* getUnchecked(Operator* func, TypeSet* args) {
+
+    if(func->type != FUN_BUILTIN)
+        return NULL;
+    for(size_t i = 0; i < NUM_UNCHECKED; i++) {
+        const struct Unchecked* op = &uncheckedOps[i];
+        if(strcmp(func->name, op->name) != 0)
+            continue;
+        for(int j = 0; j < func->arity; j++) {
+            if(args[j] != op->types[j])
+                return NULL;
+        }
+        return getBuiltin(op->unchecked);
+    }
+    return NULL;
+}
+
+/**
+ * Result type of the arithmetic intrinsics given their operand types.
+ */
+static TypeSet arithType(TypeSet a, TypeSet b) {
+
+    TypeSet res = 0;
+    if((a & TY_INTEGER) && (b & TY_INTEGER))
+        res |= TY_INTEGER;
+    if(((a | b) & TY_NUMBER) && (a & TY_NUMERIC) && (b & TY_NUMERIC))
+        res |= TY_NUMBER;
+    if(!SUBSET(a, TY_NUMERIC) || !SUBSET(b, TY_NUMERIC))
+        res |= TY_UNDEFINED;
+    return res;
+}
+
+/**
+ * Returns the type of the result of calling the given function
+ * with arguments of the given types.
+ */
+static TypeSet resultType(Operator* func, TypeSet* args) {
+
+    if(func->type != FUN_BUILTIN || strncmp(func->name, "sys:", 4) != 0)
+        return TY_ANY;
+    char* name = func->name + 4;
+    if(strcmp(name, "__add__") == 0
+        || strcmp(name, "__sub__") == 0
+        || strcmp(name, "__mul__") == 0)
+        return arithType(args[0], args[1]);
+    if(strcmp(name, "__rem__") == 0 || strcmp(name, "__pow__") == 0)
+        return arithType(args[0], args[1]) | TY_UNDEFINED;
+    if(strcmp(name, "__div__") == 0)
+        return TY_NUMBER | (arithType(args[0], args[1]) & TY_UNDEFINED);
+    if(strcmp(name, "__len__") == 0) {
+        //collections always have a length
+        if(SUBSET(args[0], TY_STRING | TY_VECT | TY_MAP | TY_SORTED | TY_LIST | TY_RANGE))
+            return TY_INTEGER;
+        return TY_INTEGER | TY_UNDEFINED;
+    }
+    if(strcmp(name, "__idiv__") == 0 || strcmp(name, "__int__") == 0)
+        return TY_INTEGER | TY_UNDEFINED;
+    if(strcmp(name, "__addInt__") == 0
+        || strcmp(name, "__subInt__") == 0
+        || strcmp(name, "__mulInt__") == 0
+        || strcmp(name, "__ltInt__") == 0
+        || strcmp(name, "__geInt__") == 0
+        || strcmp(name, "__vectLen__") == 0)
+        return TY_INTEGER;
+    if(strcmp(name, "__eqInt__") == 0)
+        return TY_NUMBER;
+    if(strcmp(name, "__neg__") == 0 || strcmp(name, "__pos__") == 0)
+        return (args[0] & TY_NUMERIC) | (SUBSET(args[0], TY_NUMERIC) ? 0 : TY_UNDEFINED);
+    if(strcmp(name, "__num__") == 0)
+        return TY_NUMBER | TY_UNDEFINED;
+    if(strcmp(name, "__eq__") == 0 || strcmp(name, "isObject") == 0)
+        return TY_NUMBER;
+    if(strcmp(name, "__lt__") == 0
+        || strcmp(name, "__ge__") == 0
+        || strcmp(name, "__bool__") == 0
+        || strcmp(name, "defined") == 0)
+        return TY_INTEGER;
+    if(strcmp(name, "__str__") == 0 || strcmp(name, "typeof") == 0)
+        return TY_STRING;
+    if(strcmp(name, "undefined") == 0)
+        return TY_UNDEFINED;
+    return TY_ANY;
+}
+
+/**
+ * Returns the type named by the given result of sys:typeof.
+ */
+static TypeSet typeNamed(LvString* name) {
+
+    static const struct {
+        char* name;
+        TypeSet type;
+    } names[] = {
+        { "undefined", TY_UNDEFINED },
+        { "number", TY_NUMBER },
+        { "int", TY_INTEGER },
+        { "string", TY_STRING },
+        { "vect", TY_VECT },
+        { "function", TY_FUNCTION },
+        { "map", TY_MAP },
+        { "sorted", TY_SORTED },
+        { "list", TY_LIST },
+        { "seq", TY_SEQ },
+        { "range", TY_RANGE },
+        { "coroutine", TY_COROUTINE },
+    };
+    for(size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if(strcmp(name->value, names[i].name) == 0)
+            return names[i].type;
+    }
+    return TY_ANY;
+}
+
+/**
+ * State of the type inference pass over one function.
+ */
+typedef struct TypeState {
+    Operator* func;
+    TypeSet* params;    //types of each param and local
+    DynBuffer stack;    //types of the values on the operand stack
+    DynBuffer thunks;   //stack height at each enclosing by name argument
+    int changed;        //number of operators replaced
+} TypeState;
+
+static void pushType(TypeState* state, TypeSet type) {
+
+    lv_buf_push(&state->stack, &type);
+}
+
+/**
+ * Pops n types from the stack and returns a pointer to the first
+ * one. The pointer is valid until the next push. Returns NULL if
+ * there are not enough values on the stack.
+ */
+static TypeSet* popTypes(TypeState* state, size_t n) {
+
+    size_t base = state->thunks.len > 0
+        ? *(size_t*)lv_buf_get(&state->thunks, state->thunks.len - 1)
+        : 0;
+    if(state->stack.len < base + n)
+        return NULL;
+    state->stack.len -= n;
+    return lv_buf_get(&state->stack, state->stack.len);
+}
+
+/**
+ * Returns whether param is a formal param passed by name. These
+ * may hold unevaluated arguments, so nothing is known about them.
+ */
+static bool isByName(Operator* func, int param) {
+
+    return param < 64 && (func->byName & (UINT64_C(1) << param));
+}
+
+/**
+ * Types of arguments a function may be copied for. The others are
+ * too rare to be worth the copies.
+ */
+#define TY_SPECIALIZED  (TY_INTEGER | TY_NUMBER | TY_STRING | TY_VECT)
+
+/**
+ * Returns the copy of the called function for the types of the
+ * given arguments, or the function itself if nothing is known
+ * about them or it cannot be copied.
+ */
+static Operator* specializeCall(Operator* func, TypeSet* args) {
+
+    if(func->type != FUN_FUNCTION
+        || func->arity == 0
+        || func->varargs
+        || func->byName
+        || func->captureCount > 0)
+        return func;
+    unsigned types[func->arity];
+    bool known = false;
+    for(int i = 0; i < func->arity; i++) {
+        //a single type, so the copy is shared by more calls
+        bool single = (args[i] & TY_SPECIALIZED) && !(args[i] & (args[i] - 1));
+        types[i] = single ? args[i] : TY_ANY;
+        known |= single;
+    }
+    return known ? lv_tb_specializeTypes(func, types) : func;
+}
+
+/**
+ * Runs the straight line code starting at pc until the next branch or
+ * return, replacing generic operators with intrinsics where the operand
+ * types allow, checked intrinsics with unchecked ones, and calls with
+ * calls of copies for the types of the arguments. Returns the index of the branch or return, or 0 if the
+ * code could not be analyzed.
+ */
+static size_t inferExpr(TypeState* state, size_t pc) {
+
+    state->stack.len = 0;
+    state->thunks.len = 0;
+    for(;; pc++) {
+        TextBufferObj* obj = &TEXT_BUFFER[pc];
+        TypeSet* args;
+        switch(obj->type) {
+            case OPT_UNDEFINED:
+                pushType(state, TY_UNDEFINED);
+                break;
+            case OPT_NUMBER:
+                pushType(state, TY_NUMBER);
+                break;
+            case OPT_INTEGER:
+                pushType(state, TY_INTEGER);
+                break;
+            case OPT_STRING:
+                pushType(state, TY_STRING);
+                break;
+            case OPT_VECT:
+                pushType(state, TY_VECT);
+                break;
+            case OPT_FUNCTION_VAL:
+            case OPT_CAPTURE:
+                pushType(state, TY_FUNCTION);
+                break;
+            case OPT_PARAM:
+            case OPT_FORCE:
+                pushType(state, state->params[obj->param]);
+                break;
+            case OPT_REG_CALL:
+                //the operands and the call follow as usual
+                pushType(state, state->params[obj->regParam]);
+                break;
+            case OPT_PUT_PARAM:
+                if(!(args = popTypes(state, 1)))
+                    return 0;
+                state->params[obj->param] = args[0];
+                break;
+            case OPT_FUNCTION: {
+                if(!(args = popTypes(state, obj->func->arity)))
+                    return 0;
+                Operator* spec = getSpecialization(obj->func);
+                if(spec) {
+                    //binary operators only forward if both operands
+                    //are object-like, so one primitive operand is enough
+                    bool primitive = SUBSET(args[0], TY_PRIMITIVE);
+                    if(spec->arity == 2)
+                        primitive |= SUBSET(args[1], TY_PRIMITIVE);
+                    if(primitive) {
+                        obj->func = spec;
+                        state->changed++;
+                    }
+                }
+                Operator* unchecked = getUnchecked(obj->func, args);
+                if(unchecked) {
+                    obj->func = unchecked;
+                    state->changed++;
+                }
+                Operator* callee = obj->func;
+                Operator* typed = specializeCall(callee, args);
+                if(typed != callee) {
+                    //copying the function may move the text buffer
+                    TEXT_BUFFER[pc].func = typed;
+                    state->changed++;
+                }
+                pushType(state, resultType(TEXT_BUFFER[pc].func, args));
+                break;
+            }
+            case OPT_FUNC_CAP: {
+                //the function value is counted as a capture here
+                if(!popTypes(state, TEXT_BUFFER[pc - 1].func->captureCount + 1))
+                    return 0;
+                pushType(state, TY_FUNCTION);
+                break;
+            }
+            case OPT_FUNC_CALL:
+                //callArity does not include the function
+                if(!popTypes(state, obj->callArity + 1))
+                    return 0;
+                pushType(state, TY_ANY);
+                break;
+            case OPT_FUNC_CALL2: {
+                //the function is below its arguments
+                if(!(args = popTypes(state, obj->callArity)))
+                    return 0;
+                Operator* at = getBuiltin("sys:__vectAt__");
+                if(obj->callArity == 2 && args[0] == TY_VECT && args[1] == TY_INTEGER && at) {
+                    //indexing a vect, with the operands in the same order
+                    obj->type = OPT_FUNCTION;
+                    obj->func = at;
+                    state->changed++;
+                }
+                pushType(state, TY_ANY);
+                break;
+            }
+            case OPT_MAKE_VECT:
+                if(!popTypes(state, obj->callArity))
+                    return 0;
+                pushType(state, TY_VECT);
+                break;
+            case OPT_MAKE_THUNK:
+                //the argument's code is evaluated on its own stack
+                lv_buf_push(&state->thunks, &state->stack.len);
+                break;
+            case OPT_END_THUNK:
+                if(state->thunks.len == 0)
+                    return 0;
+                lv_buf_pop(&state->thunks, &state->stack.len);
+                pushType(state, TY_ANY);
+                break;
+            case OPT_DISPATCH:
+                //the guards following the table are analyzed as usual
+                break;
+            case OPT_BEQZ:
+            case OPT_RETURN:
+                return (state->stack.len == 1 && state->thunks.len == 0) ? pc : 0;
+            case OPT_JUMP:
+                return (state->stack.len == 0 && state->thunks.len == 0) ? pc : 0;
+            default:
+                return 0;
+        }
+    }
+}
+
+/**
+ * If the condition from bgn to end has the form `sys:typeof(param) = name`,
+ * narrows the type of the param in the body of the piece.
+ */
+static void narrowGuard(TypeState* state, size_t bgn, size_t end) {
+
+    TextBufferObj* cond = TEXT_BUFFER + bgn;
+    if(end - bgn != 4
+        || cond[0].type != OPT_PARAM
+        || isByName(state->func, cond[0].param)
+        || cond[1].type != OPT_FUNCTION
+        || strcmp(cond[1].func->name, "sys:typeof") != 0
+        || cond[2].type != OPT_STRING
+        || cond[3].type != OPT_FUNCTION)
+        return;
+    //the comparison was already replaced if possible
+    if(strcmp(cond[3].func->name, "sys:__eq__") != 0)
+        return;
+    state->params[cond[0].param] &= typeNamed(cond[2].str);
+}
+
+int lv_expr_inferTypes(Operator* func) {
+
+    int numParams = func->arity + func->locals;
+    TypeState state;
+    state.func = func;
+    state.changed = 0;
+    state.params = lv_alloc((numParams + 1) * sizeof(TypeSet));
+    lv_buf_init(&state.stack, sizeof(TypeSet));
+    lv_buf_init(&state.thunks, sizeof(size_t));
+    //nothing is known about the arguments, unless this is a copy for their types
+    for(int i = 0; i < numParams; i++)
+        state.params[i] = (func->paramTypes && i < func->arity) ? func->paramTypes[i] : TY_ANY;
+    TypeSet narrowed[numParams + 1];
+    size_t pc = func->textOffset;
+    while(true) {
+        size_t branch = inferExpr(&state, pc);
+        if(!branch || TEXT_BUFFER[branch].type == OPT_RETURN)
+            break;
+        //the locals jump directly to the first piece
+        if(TEXT_BUFFER[branch].type != OPT_JUMP) {
+            //the body of the piece runs when the condition holds
+            memcpy(narrowed, state.params, numParams * sizeof(TypeSet));
+            narrowGuard(&state, pc, branch);
+            size_t end = inferExpr(&state, branch + 1);
+            memcpy(state.params, narrowed, numParams * sizeof(TypeSet));
+            if(!end)
+                break;
+        }
+        pc = branch + TEXT_BUFFER[branch].branchAddr;
+    }
+    lv_free(state.stack.data);
+    lv_free(state.thunks.data);
+    lv_free(state.params);
+    return state.changed;
+}
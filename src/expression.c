@@ -2,6 +2,12 @@
 #include "textbuffer.h"
 #include "operator.h"
 #include "lavender.h"
+#include "map.h"
+#include "sorted.h"
+#include "vect.h"
+#include "list.h"
+#include "seq.h"
+#include "coroutine.h"
 #include <assert.h>
 
 char* lv_expr_getError(ExprError error) {
@@ -37,15 +43,38 @@ void lv_expr_cleanup(TextBufferObj* obj, size_t len) {
         } else if(obj[i].type == OPT_CAPTURE) {
             assert(obj[i].capture->refCount);
             if(--obj[i].capture->refCount == 0) {
-                lv_expr_cleanup(obj[i].capture->value, obj[i].capfunc->captureCount);
+                lv_expr_cleanup(obj[i].capture->value, obj[i].capture->func->captureCount);
                 lv_free(obj[i].capture);
             }
         } else if(obj[i].type == OPT_VECT) {
             assert(obj[i].vect->refCount);
             if(--obj[i].vect->refCount == 0) {
-                lv_expr_cleanup(obj[i].vect->data, obj[i].vect->len);
-                lv_free(obj[i].vect);
+                lv_vect_free(obj[i].vect);
             }
+        } else if(obj[i].type == OPT_MAP) {
+            assert(obj[i].map->refCount);
+            if(--obj[i].map->refCount == 0)
+                lv_map_free(obj[i].map);
+        } else if(obj[i].type == OPT_SORTED) {
+            assert(obj[i].sorted->refCount);
+            if(--obj[i].sorted->refCount == 0)
+                lv_sorted_free(obj[i].sorted);
+        } else if(obj[i].type == OPT_LIST) {
+            assert(obj[i].list->refCount);
+            if(--obj[i].list->refCount == 0)
+                lv_list_free(obj[i].list);
+        } else if(obj[i].type == OPT_SEQ) {
+            assert(obj[i].seq->refCount);
+            if(--obj[i].seq->refCount == 0)
+                lv_seq_free(obj[i].seq);
+        } else if(obj[i].type == OPT_RANGE) {
+            assert(obj[i].range->refCount);
+            if(--obj[i].range->refCount == 0)
+                lv_free(obj[i].range);
+        } else if(obj[i].type == OPT_COROUTINE) {
+            assert(obj[i].coroutine->refCount);
+            if(--obj[i].coroutine->refCount == 0)
+                lv_coroutine_free(obj[i].coroutine);
         }
     }
 }
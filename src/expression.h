@@ -44,6 +44,17 @@ Operator* lv_expr_declareFunction(Token* tokens, Operator* nspace, Token** bodyT
  */
 Token* lv_expr_parseExpr(Token* tokens, Operator* decl, TextBufferObj** res, size_t* len);
 
+/**
+ * Infers the types of values in the code of the given function,
+ * and replaces generic operators with the intrinsics they fall
+ * back to where the operands are known not to be object-like,
+ * and intrinsics with unchecked versions where the operand types
+ * are known exactly. Calls passing arguments of known types call
+ * a copy of the function for those types instead (see
+ * lv_tb_specializeTypes). Returns the number of operators replaced.
+ */
+int lv_expr_inferTypes(Operator* func);
+
 /**
  * Calls lv_expr_cleanup and additionally frees obj.
  */
@@ -0,0 +1,231 @@
+#include "kernel.h"
+#include "lavender.h"
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define WIDTH 4
+typedef __m256d VDouble;
+#define VLOAD(p) _mm256_loadu_pd(p)
+#define VSTORE(p, v) _mm256_storeu_pd(p, v)
+#define VSET1(x) _mm256_set1_pd(x)
+#define VADD(x, y) _mm256_add_pd(x, y)
+#define VSUB(x, y) _mm256_sub_pd(x, y)
+#define VMUL(x, y) _mm256_mul_pd(x, y)
+#define VDIV(x, y) _mm256_div_pd(x, y)
+#define VMIN(x, y) _mm256_min_pd(x, y)
+#define VMAX(x, y) _mm256_max_pd(x, y)
+#define VLT(x, y) _mm256_cmp_pd(x, y, _CMP_LT_OQ)
+#define VLE(x, y) _mm256_cmp_pd(x, y, _CMP_LE_OQ)
+#define VEQ(x, y) _mm256_cmp_pd(x, y, _CMP_EQ_OQ)
+#define VAND(x, y) _mm256_and_pd(x, y)
+#define VANDNOT(x, y) _mm256_andnot_pd(x, y)
+#define VSQRT(x) _mm256_sqrt_pd(x)
+#define VINT1(i) _mm256_castsi256_pd(_mm256_set1_epi64x(i))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define WIDTH 2
+typedef __m128d VDouble;
+#define VLOAD(p) _mm_loadu_pd(p)
+#define VSTORE(p, v) _mm_storeu_pd(p, v)
+#define VSET1(x) _mm_set1_pd(x)
+#define VADD(x, y) _mm_add_pd(x, y)
+#define VSUB(x, y) _mm_sub_pd(x, y)
+#define VMUL(x, y) _mm_mul_pd(x, y)
+#define VDIV(x, y) _mm_div_pd(x, y)
+#define VMIN(x, y) _mm_min_pd(x, y)
+#define VMAX(x, y) _mm_max_pd(x, y)
+#define VLT(x, y) _mm_cmplt_pd(x, y)
+#define VLE(x, y) _mm_cmple_pd(x, y)
+#define VEQ(x, y) _mm_cmpeq_pd(x, y)
+#define VAND(x, y) _mm_and_pd(x, y)
+#define VANDNOT(x, y) _mm_andnot_pd(x, y)
+#define VSQRT(x) _mm_sqrt_pd(x)
+#define VINT1(i) _mm_castsi128_pd(_mm_set1_epi64x(i))
+#endif
+
+//scalar forms, matching the vector instructions
+#define SADD(x, y) ((x) + (y))
+#define SSUB(x, y) ((x) - (y))
+#define SMUL(x, y) ((x) * (y))
+#define SDIV(x, y) ((x) / (y))
+#define SMIN(x, y) ((x) < (y) ? (x) : (y))
+#define SMAX(x, y) ((x) > (y) ? (x) : (y))
+#define SLT(x, y) ((x) < (y))
+#define SLE(x, y) ((x) <= (y))
+#define SEQ(x, y) ((x) == (y))
+
+#ifdef WIDTH
+#define VECTOR_LOOP(out, VEXPR) \
+    for(; i + WIDTH <= len; i += WIDTH) { \
+        VDouble x = aScalar ? VSET1(*a) : VLOAD(a + i); \
+        VDouble y = bScalar ? VSET1(*b) : VLOAD(b + i); \
+        VSTORE(out + i, VEXPR); \
+    }
+#else
+#define VECTOR_LOOP(out, VEXPR)
+#endif
+
+#define SCALAR_LOOP(out, SEXPR) \
+    for(; i < len; i++) { \
+        double x = aScalar ? *a : a[i]; \
+        double y = bScalar ? *b : b[i]; \
+        out[i] = SEXPR; \
+    }
+
+#define ARITH_CASE(op, V, S) \
+    case op: \
+        VECTOR_LOOP(numbers, V(x, y)) \
+        SCALAR_LOOP(numbers, S(x, y)) \
+        break;
+
+//comparison masks are anded with 1 to give integer 0 or 1
+#define COMPARE_CASE(op, V, S) \
+    case op: \
+        VECTOR_LOOP((double*)integers, VAND(V(x, y), VINT1(1))) \
+        SCALAR_LOOP(integers, S(x, y)) \
+        break;
+
+void lv_kernel_numbers(KernelOp op, void* dst, const double* a, bool aScalar,
+    const double* b, bool bScalar, size_t len) {
+
+    double* numbers = dst;
+    uint64_t* integers = dst;
+    size_t i = 0;
+    switch(op) {
+        ARITH_CASE(KERNEL_ADD, VADD, SADD)
+        ARITH_CASE(KERNEL_SUB, VSUB, SSUB)
+        ARITH_CASE(KERNEL_MUL, VMUL, SMUL)
+        ARITH_CASE(KERNEL_DIV, VDIV, SDIV)
+        ARITH_CASE(KERNEL_MIN, VMIN, SMIN)
+        ARITH_CASE(KERNEL_MAX, VMAX, SMAX)
+        COMPARE_CASE(KERNEL_LT, VLT, SLT)
+        COMPARE_CASE(KERNEL_LE, VLE, SLE)
+        COMPARE_CASE(KERNEL_EQ, VEQ, SEQ)
+    }
+}
+
+#undef VECTOR_LOOP
+#undef ARITH_CASE
+#undef COMPARE_CASE
+
+//the compiler vectorizes these loops where the target allows
+#define INTEGER_CASE(op, EXPR) \
+    case op: \
+        for(size_t i = 0; i < len; i++) { \
+            uint64_t x = aScalar ? *a : a[i]; \
+            uint64_t y = bScalar ? *b : b[i]; \
+            dst[i] = EXPR; \
+        } \
+        break;
+
+void lv_kernel_integers(KernelOp op, uint64_t* dst, const uint64_t* a, bool aScalar,
+    const uint64_t* b, bool bScalar, size_t len) {
+
+    switch(op) {
+        INTEGER_CASE(KERNEL_ADD, x + y)
+        INTEGER_CASE(KERNEL_SUB, x - y)
+        INTEGER_CASE(KERNEL_MUL, x * y)
+        INTEGER_CASE(KERNEL_MIN, (int64_t)x < (int64_t)y ? x : y)
+        INTEGER_CASE(KERNEL_MAX, (int64_t)x > (int64_t)y ? x : y)
+        INTEGER_CASE(KERNEL_LT, (int64_t)x < (int64_t)y)
+        INTEGER_CASE(KERNEL_LE, (int64_t)x <= (int64_t)y)
+        INTEGER_CASE(KERNEL_EQ, x == y)
+        case KERNEL_DIV:
+            assert(false);
+    }
+}
+
+#undef INTEGER_CASE
+
+void lv_kernel_sqrt(double* dst, const double* src, size_t len) {
+
+    size_t i = 0;
+#ifdef WIDTH
+    for(; i + WIDTH <= len; i += WIDTH)
+        VSTORE(dst + i, VSQRT(VLOAD(src + i)));
+#endif
+    for(; i < len; i++)
+        dst[i] = sqrt(src[i]);
+}
+
+void lv_kernel_abs(double* dst, const double* src, size_t len) {
+
+    size_t i = 0;
+#ifdef WIDTH
+    //clear the sign bits
+    VDouble sign = VSET1(-0.0);
+    for(; i + WIDTH <= len; i += WIDTH)
+        VSTORE(dst + i, VANDNOT(sign, VLOAD(src + i)));
+#endif
+    for(; i < len; i++)
+        dst[i] = fabs(src[i]);
+}
+
+#define SIGN_BIT ((uint64_t)1 << 63)
+
+/**
+ * Maps a value to an unsigned key with the same order. Doubles are
+ * mapped so that equal values have equal keys, keeping the sort stable.
+ */
+static inline uint64_t sortKey(uint64_t bits, bool number) {
+
+    if(!number)
+        return bits ^ SIGN_BIT;
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    if(x != x) {
+        bits = 0x7ff8000000000000; //every NaN sorts as a positive NaN
+    } else if(x == 0.0) {
+        bits = 0; //-0.0 sorts as 0.0
+    }
+    return (bits & SIGN_BIT) ? ~bits : bits | SIGN_BIT;
+}
+
+/** Least significant digit radix sort, a byte at a time. */
+static void radixSort(uint64_t* vals, size_t len, bool number) {
+
+    if(len < 2)
+        return;
+    size_t counts[8][256] = { { 0 } };
+    for(size_t i = 0; i < len; i++) {
+        uint64_t key = sortKey(vals[i], number);
+        for(int b = 0; b < 8; b++)
+            counts[b][(key >> (8 * b)) & 0xff]++;
+    }
+    uint64_t* tmp = lv_alloc(len * sizeof(uint64_t));
+    uint64_t* src = vals;
+    uint64_t* dst = tmp;
+    for(int b = 0; b < 8; b++) {
+        int shift = 8 * b;
+        //skip the pass if every key has the same digit
+        if(counts[b][(sortKey(src[0], number) >> shift) & 0xff] == len)
+            continue;
+        size_t offset = 0;
+        for(int d = 0; d < 256; d++) {
+            size_t count = counts[b][d];
+            counts[b][d] = offset;
+            offset += count;
+        }
+        for(size_t i = 0; i < len; i++)
+            dst[counts[b][(sortKey(src[i], number) >> shift) & 0xff]++] = src[i];
+        uint64_t* swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if(src != vals)
+        memcpy(vals, src, len * sizeof(uint64_t));
+    lv_free(tmp);
+}
+
+void lv_kernel_sortIntegers(uint64_t* vals, size_t len) {
+
+    radixSort(vals, len, false);
+}
+
+void lv_kernel_sortNumbers(double* vals, size_t len) {
+
+    radixSort((uint64_t*)vals, len, true);
+}
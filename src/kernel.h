@@ -0,0 +1,60 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Elementwise kernels over arrays of doubles and integers, used by
+ * the builtins on packed vects. The double kernels use SSE2 or AVX
+ * when the compiler targets them, and plain loops otherwise. An
+ * operand flagged as scalar is a single value broadcast to every
+ * element. Integers are two's complement, as in Lavender ints.
+ */
+
+typedef enum KernelOp {
+    KERNEL_ADD,
+    KERNEL_SUB,
+    KERNEL_MUL,
+    KERNEL_DIV,
+    KERNEL_MIN,
+    KERNEL_MAX,
+    KERNEL_LT,  //comparisons give 1 or 0
+    KERNEL_LE,
+    KERNEL_EQ,
+} KernelOp;
+
+/** Whether the operation is a comparison. */
+#define LV_KERNEL_COMPARES(op) ((op) >= KERNEL_LT)
+
+/**
+ * Applies the operation to each pair of elements of a and b. The
+ * results of comparisons are stored as integers in dst, and the
+ * results of arithmetic as doubles. dst may alias a or b.
+ */
+void lv_kernel_numbers(KernelOp op, void* dst, const double* a, bool aScalar,
+    const double* b, bool bScalar, size_t len);
+
+/**
+ * Applies the operation to each pair of integers of a and b. The
+ * operation must not be KERNEL_DIV. dst may alias a or b.
+ */
+void lv_kernel_integers(KernelOp op, uint64_t* dst, const uint64_t* a, bool aScalar,
+    const uint64_t* b, bool bScalar, size_t len);
+
+/** Stores the square root of each element of src in dst. */
+void lv_kernel_sqrt(double* dst, const double* src, size_t len);
+
+/** Stores the absolute value of each element of src in dst. */
+void lv_kernel_abs(double* dst, const double* src, size_t len);
+
+/** Sorts signed integers in ascending order with a radix sort. */
+void lv_kernel_sortIntegers(uint64_t* vals, size_t len);
+
+/**
+ * Sorts doubles in ascending order with a stable radix sort. As in
+ * sys:__lt__, NaNs come last and zeros of either sign compare equal.
+ */
+void lv_kernel_sortNumbers(double* vals, size_t len);
+
+#endif
@@ -3,6 +3,9 @@
 #include "operator.h"
 #include "builtin.h"
 #include "command.h"
+#include "optimize.h"
+#include "memo.h"
+#include "coroutine.h"
 #include "dynbuffer.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -10,6 +13,7 @@
 #include <assert.h>
 
 bool lv_debug = false;
+int lv_optLevel = 2;
 char* lv_filepath = ".";
 char* lv_mainFile = NULL;
 size_t lv_maxStackSize = 512 * 1024; //512KiB
@@ -24,6 +28,8 @@ static size_t pc;   //program counter
 static size_t fp;   //frame pointer: index of the first argument
 // static Operator* atFunc; //built in sys:__at__
 static Operator atFunc; //built in sys:__at__
+static LvCoroutine* running;    //innermost coroutine being resumed
+static size_t nativeDepth;      //number of lv_callFunction calls running
 
 static void push(TextBufferObj* obj) {
 
@@ -100,12 +106,16 @@ void lv_run(void) {
                 args.type = OPT_VECT;
                 args.vect = lv_alloc(sizeof(LvVect) + lv_mainArgs.count * sizeof(TextBufferObj));
                 args.vect->refCount = 0;
+                args.vect->hash = 0;
+                args.vect->tree = NULL;
+                args.vect->packed = OPT_UNDEFINED;
                 args.vect->len = lv_mainArgs.count;
                 for(size_t i = 0; i < args.vect->len; i++) {
                     size_t argLen = strlen(lv_mainArgs.args[i]);
                     LvString* str =
                         lv_alloc(sizeof(LvString) + argLen + 1);
                     str->refCount = 1;
+                    str->hash = 0;
                     str->len = argLen;
                     strcpy(str->value, lv_mainArgs.args[i]);
                     args.vect->data[i].type = OPT_STRING;
@@ -193,6 +203,8 @@ void lv_startup(void) {
 
 void lv_shutdown(void) {
 
+    lv_opt_onShutdown();
+    lv_memo_onShutdown();
     lv_cmd_onShutdown();
     lv_blt_onShutdown();
     lv_tb_onShutdown();
@@ -430,6 +442,9 @@ static void makeVect(int length) {
     vect.type = OPT_VECT;
     vect.vect = lv_alloc(sizeof(LvVect) + length * sizeof(TextBufferObj));
     vect.vect->refCount = 0;
+    vect.vect->hash = 0;
+    vect.vect->tree = NULL;
+    vect.vect->packed = OPT_UNDEFINED;
     vect.vect->len = length;
     for(size_t i = vect.vect->len; i > 0; i--) {
         //preserve refCounts because we are transferring to vect
@@ -441,9 +456,9 @@ static void makeVect(int length) {
 /**
  * Prepares the stack for calling the given function with the
  * given number of arguments. Returns whether the setup is successful
- * and sets op to the underlying operator. If the function is a string
- * or a vector, and one argument is passed, the underlying operator is
- * set to the built in __at__ function.
+ * and sets op to the underlying operator. If the function is a string,
+ * vector, map, or sorted map, and one argument is passed, the underlying
+ * operator is set to the built in __at__ function.
  */
 static bool setUpFuncCall(TextBufferObj* func, size_t numArgs, Operator** underlying) {
 
@@ -467,7 +482,7 @@ static bool setUpFuncCall(TextBufferObj* func, size_t numArgs, Operator** underl
             break;
         }
         case OPT_CAPTURE: {
-            op = func->capfunc;
+            op = func->capture->func;
             int nonCapArity = op->arity - op->captureCount;
             //collect varargs into vect
             if(op->varargs) {
@@ -488,6 +503,9 @@ static bool setUpFuncCall(TextBufferObj* func, size_t numArgs, Operator** underl
         }
         case OPT_STRING:
         case OPT_VECT:
+        case OPT_MAP:
+        case OPT_SORTED:
+        case OPT_RANGE:
             if(numArgs == 1) {
                 op = &atFunc;
                 push(func);
@@ -504,6 +522,25 @@ static bool setUpFuncCall(TextBufferObj* func, size_t numArgs, Operator** underl
     return success;
 }
 
+/**
+ * Pushes the result of a call that did not push a frame. The result
+ * replaces the function of an OPT_FUNC_CALL2 if there is one.
+ */
+static void pushResult(TextBufferObj* res) {
+
+    if(stack.len > 0) {
+        TextBufferObj* top = lv_buf_get(&stack, stack.len - 1);
+        if(top->type == OPT_FUNC_CALL2) {
+            //must increment refCount manually
+            if(res->type & LV_DYNAMIC)
+                ++*res->refCount;
+            *top = *res;
+            return;
+        }
+    }
+    push(res);
+}
+
 /**
  * Calls the given function by saving the current stack frame
  * and jumping to the first instruction of the given function.
@@ -525,21 +562,28 @@ static size_t jumpAndLink(Operator* func) {
             //(current) value.
             size_t tmpFp = stack.len - func->arity;
             TextBufferObj res = func->builtin(lv_buf_get(&stack, tmpFp));
+            //hold the result in case it is one of the args
+            if(res.type & LV_DYNAMIC)
+                ++*res.refCount;
             popAll(func->arity);
-            if(stack.len > 0) {
-                TextBufferObj* top = lv_buf_get(&stack, stack.len - 1);
-                if(top->type == OPT_FUNC_CALL2) {
-                    //must increment refCount manually
-                    if(res.type & LV_DYNAMIC)
-                        ++*res.refCount;
-                    *top = res;
-                    break;
-                }
-            } //else
-            push(&res);
+            pushResult(&res);
+            if(res.type & LV_DYNAMIC)
+                --*res.refCount;
             break;
         }
         case FUN_FUNCTION: {
+            //memoized functions may already know the result
+            MemoTable* memo = (func->generic ? func->generic : func)->memo;
+            if(memo) {
+                TextBufferObj* args = lv_buf_get(&stack, stack.len - func->arity);
+                TextBufferObj res;
+                if(lv_memo_get(memo, args, func->arity, &res)) {
+                    //like a builtin, no frame is pushed
+                    popAll(func->arity);
+                    pushResult(&res);
+                    break;
+                }
+            }
             //calling convention
             //  0. push <undefined> into local slots
             //  1. push fp
@@ -562,6 +606,8 @@ static size_t jumpAndLink(Operator* func) {
             obj.addr = pc;
             push(&obj);
             pc = func->textOffset;
+            if(memo)
+                lv_memo_enter(memo, lv_buf_get(&stack, fp), func->arity, fp);
             break;
         }
     }
@@ -580,10 +626,11 @@ static void runCycle(void) {
             assert(func.func->type == FUN_FUNCTION); //only Lv functions can capture
             TextBufferObj obj;
             obj.type = OPT_CAPTURE;
-            obj.capfunc = func.func;
             obj.capture = lv_alloc(sizeof(CaptureObj)
                 + func.func->captureCount * sizeof(TextBufferObj));
             obj.capture->refCount = 0;
+            obj.capture->hash = 0;
+            obj.capture->func = func.func;
             for(int i = func.func->captureCount - 1; i >= 0; i--) {
                 //preserve refCounts because we are transferring to capture
                 lv_buf_pop(&stack, &obj.capture->value[i]);
@@ -602,6 +649,12 @@ static void runCycle(void) {
         case OPT_STRING:
         case OPT_CAPTURE:
         case OPT_VECT:
+        case OPT_MAP:
+        case OPT_SORTED:
+        case OPT_LIST:
+        case OPT_SEQ:
+        case OPT_RANGE:
+        case OPT_COROUTINE:
             //push it on the stack
             push(value);
             break;
@@ -609,6 +662,52 @@ static void runCycle(void) {
             //push i'th param
             push(lv_buf_get(&stack, fp + value->param));
             break;
+        case OPT_FORCE: {
+            //push i'th param if it has been evaluated
+            TextBufferObj* param = lv_buf_get(&stack, fp + value->param);
+            if(param->type != OPT_THUNK) {
+                push(param);
+                break;
+            }
+            //evaluate the argument in the frame it was passed from.
+            //The stack looks like this:
+            //  ... fp pc ...
+            //OPT_END_THUNK stores the result back into the param
+            TextBufferObj thunk = *param;
+            TextBufferObj obj;
+            obj.type = OPT_ADDR;
+            obj.addr = fp;
+            push(&obj);
+            obj.addr = pc;
+            push(&obj);
+            fp = thunk.thunkFp;
+            pc = thunk.thunkAddr;
+            break;
+        }
+        case OPT_MAKE_THUNK: {
+            //push the unevaluated argument and skip its code
+            TextBufferObj thunk;
+            thunk.type = OPT_THUNK;
+            thunk.thunkAddr = pc;
+            thunk.thunkFp = fp;
+            push(&thunk);
+            pc += value->branchAddr - 1;
+            break;
+        }
+        case OPT_END_THUNK: {
+            //bypass removeTop for the result so
+            //the param slot keeps the refCount
+            TextBufferObj res;
+            lv_buf_pop(&stack, &res);
+            pc = removeTop().addr;
+            fp = removeTop().addr;
+            //the instruction before pc is the OPT_FORCE
+            //that evaluated this argument
+            TextBufferObj* param = lv_buf_get(&stack, fp + TEXT_BUFFER[pc - 1].param);
+            *param = res;
+            push(&res);
+            break;
+        }
         case OPT_PUT_PARAM: {
             //pop top and place in i'th param
             TextBufferObj* param = lv_buf_get(&stack, fp + value->param);
@@ -622,6 +721,35 @@ static void runCycle(void) {
                 pc += value->branchAddr - 1;
             break;
         }
+        case OPT_JUMP:
+            pc += value->branchAddr - 1;
+            break;
+        case OPT_DISPATCH: {
+            DispatchTable* table = value->table;
+            if(!table->checked) {
+                //global:= is sys:__eq__ as long as the compared
+                //functions are not object-like. Until we know,
+                //just evaluate the guards.
+                table->checked = true;
+                table->usable = false;
+                bool usable = true;
+                for(size_t i = 0; i < table->size && table->checkObjects; i++) {
+                    Operator* func = table->entries[i].func;
+                    if(func && lv_blt_isObjectFunc(func))
+                        usable = false;
+                }
+                table->usable = usable;
+            }
+            if(table->usable) {
+                TextBufferObj* param = lv_buf_get(&stack, fp + table->param);
+                //only function values can compare equal to the functions
+                int target = (param->type == OPT_FUNCTION_VAL)
+                    ? lv_tb_dispatch(table, param->func)
+                    : table->end;
+                pc += target - 1;
+            }
+            break;
+        }
         case OPT_FUNC_CALL: {
             Operator* op;
             lv_buf_pop(&stack, &func);
@@ -663,12 +791,33 @@ static void runCycle(void) {
             jumpAndLink(value->func);
             break;
         }
+        case OPT_REG_CALL: {
+            //the other operands are params or constants, and the
+            //builtin follows them. Operands are read from the frame
+            //and the text buffer instead of being pushed.
+            int numArgs = value->regArgs;
+            TextBufferObj args[numArgs];
+            args[0] = *(TextBufferObj*)lv_buf_get(&stack, fp + value->regParam);
+            for(int i = 1; i < numArgs; i++) {
+                TextBufferObj* operand = &TEXT_BUFFER[pc++];
+                args[i] = operand->type == OPT_PARAM
+                    ? *(TextBufferObj*)lv_buf_get(&stack, fp + operand->param)
+                    : *operand;
+            }
+            Operator* op = TEXT_BUFFER[pc++].func;
+            assert(op->type == FUN_BUILTIN && op->arity == numArgs);
+            //the operands are kept alive by their owners
+            TextBufferObj res = op->builtin(args);
+            push(&res);
+            break;
+        }
         case OPT_RETURN: {
             //bypass removeTop for the return value
             //so we keep its string refCount intact
             //this keeps popAll from freeing the return value
             TextBufferObj retVal;
             lv_buf_pop(&stack, &retVal);
+            lv_memo_leave(fp, &retVal);
             //reset pc and fp
             pc = removeTop().addr;
             size_t tmpFp = removeTop().addr;
@@ -688,6 +837,7 @@ static void runCycle(void) {
         case OPT_LITERAL:
         case OPT_ADDR:
         case OPT_EMPTY_ARGS:
+        case OPT_THUNK:
             assert(false);
             return;
     }
@@ -710,9 +860,119 @@ void lv_callFunction(TextBufferObj* func, size_t numArgs, TextBufferObj* args, T
         size_t frame = jumpAndLink(op);
         //we stop executing when the frame pushed by
         //jumpAndLink is popped.
+        nativeDepth++;
         while(fp != frame) {
             runCycle();
         }
+        nativeDepth--;
         *ret = removeTop();
     }
 }
+
+/**
+ * Calls the function of the coroutine with the argument on top of
+ * its stack. A coroutine that does not loop releases its function,
+ * since it is only called once.
+ */
+static void callCoroutine(LvCoroutine* co) {
+
+    TextBufferObj func = co->func;
+    if(!co->loop)
+        co->func.type = OPT_UNDEFINED;
+    co->yielded = false;
+    Operator* op;
+    if(setUpFuncCall(&func, 1, &op)) {
+        jumpAndLink(op);
+    } else {
+        TextBufferObj undef;
+        undef.type = OPT_UNDEFINED;
+        push(&undef);
+    }
+    if(!co->loop)
+        lv_expr_cleanup(&func, 1);
+}
+
+/**
+ * Runs the coroutine on its own stack until it yields or returns.
+ * The coroutine must be new or suspended. A new coroutine calls its
+ * function with the input, and a suspended one returns the input
+ * from the yield it stopped at.
+ */
+void lv_resumeCoroutine(LvCoroutine* co, TextBufferObj* input) {
+
+    assert(co->state == CO_NEW || co->state == CO_SUSPENDED);
+    //switch to the coroutine's stack
+    DynBuffer outerStack = stack;
+    size_t outerPc = pc;
+    size_t outerFp = fp;
+    LvCoroutine* outer = running;
+    size_t memoFloor = lv_memo_switchStack();
+    running = co;
+    co->depth = nativeDepth;
+    if(co->state == CO_NEW) {
+        co->state = CO_RUNNING;
+        lv_buf_init(&stack, sizeof(TextBufferObj));
+        pc = fp = 0;
+        push(input);
+        callCoroutine(co);
+    } else {
+        stack = co->stack;
+        pc = co->pc;
+        fp = co->fp;
+        co->state = CO_RUNNING;
+        //the input replaces the placeholder result of the yield
+        TextBufferObj* top = lv_buf_get(&stack, stack.len - 1);
+        lv_expr_cleanup(top, 1);
+        *top = *input;
+        if(top->type & LV_DYNAMIC)
+            ++*top->refCount;
+    }
+    //the frames of the coroutine are gone once only its result is left
+    while(co->state == CO_RUNNING) {
+        if(stack.len != 1) {
+            runCycle();
+        } else if(co->loop && co->yielded) {
+            //the result is the argument to the next call
+            callCoroutine(co);
+        } else {
+            break;
+        }
+    }
+    if(co->state == CO_RUNNING) {
+        //keep the reference to the result
+        lv_expr_cleanup(&co->value, 1);
+        lv_buf_pop(&stack, &co->value);
+        lv_free(stack.data);
+        co->stack.data = NULL;
+        co->stack.cap = co->stack.len = 0;
+        co->state = CO_DONE;
+    } else {
+        co->stack = stack;
+        co->pc = pc;
+        co->fp = fp;
+    }
+    stack = outerStack;
+    pc = outerPc;
+    fp = outerFp;
+    running = outer;
+    lv_memo_switchBack(memoFloor);
+}
+
+/**
+ * Suspends the running coroutine with the given value once the
+ * current instruction finishes. Returns false if there is no running
+ * coroutine, or if the yield is in a function called by a builtin,
+ * since the builtin cannot be suspended.
+ */
+bool lv_yieldCoroutine(TextBufferObj* value) {
+
+    if(!running || running->state != CO_RUNNING || running->depth != nativeDepth)
+        return false;
+    if(value->type & LV_DYNAMIC)
+        ++*value->refCount;
+    lv_expr_cleanup(&running->value, 1);
+    running->value = *value;
+    running->state = CO_SUSPENDED;
+    running->yielded = true;
+    return true;
+}
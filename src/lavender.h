@@ -5,6 +5,7 @@
 #include <stddef.h>
 
 bool lv_debug;
+int lv_optLevel;
 char* lv_filepath;
 char* lv_mainFile;
 size_t lv_maxStackSize;
@@ -17,6 +18,8 @@ void lv_run(void);
 void lv_repl(void);
 bool lv_readFile(char* name);
 void lv_callFunction(TextBufferObj* func, size_t numArgs, TextBufferObj* args, TextBufferObj* ret);
+void lv_resumeCoroutine(LvCoroutine* co, TextBufferObj* input);
+bool lv_yieldCoroutine(TextBufferObj* value);
 void lv_startup(void);
 void lv_shutdown(void);
 void* lv_alloc(size_t size);
@@ -0,0 +1,118 @@
+#include "list.h"
+#include "textbuffer.h"
+#include "expression.h"
+#include "lavender.h"
+#include <assert.h>
+
+static void incRefCount(TextBufferObj* obj) {
+
+    if(obj->type & LV_DYNAMIC)
+        ++*obj->refCount;
+}
+
+static LvList* newCell(TextBufferObj* head, LvList* tail, size_t len) {
+
+    LvList* list = lv_alloc(sizeof(LvList));
+    list->refCount = 0;
+    list->hash = 0;
+    list->len = len;
+    list->tail = tail;
+    if(head) {
+        list->head = *head;
+        incRefCount(&list->head);
+    } else {
+        list->head.type = OPT_UNDEFINED;
+    }
+    return list;
+}
+
+LvList* lv_list_empty(void) {
+
+    return newCell(NULL, NULL, 0);
+}
+
+LvList* lv_list_cons(TextBufferObj* head, LvList* tail) {
+
+    //the empty list is never linked
+    if(tail->len)
+        tail->refCount++;
+    return newCell(head, tail->len ? tail : NULL, tail->len + 1);
+}
+
+LvList* lv_list_tail(LvList* list) {
+
+    assert(list->len);
+    return list->tail ? list->tail : lv_list_empty();
+}
+
+LvList* lv_list_append(LvList* a, LvList* b) {
+
+    if(a->len == 0)
+        return b;
+    ListBuilder builder;
+    lv_list_start(&builder);
+    for(LvList* cell = a; cell; cell = cell->tail)
+        lv_list_push(&builder, &cell->head);
+    return lv_list_finish(&builder, b);
+}
+
+LvList* lv_list_reverse(LvList* list) {
+
+    LvList* res = lv_list_empty();
+    for(LvList* cell = list->len ? list : NULL; cell; cell = cell->tail) {
+        LvList* tmp = lv_list_cons(&cell->head, res);
+        if(res->len == 0)
+            lv_free(res);
+        res = tmp;
+    }
+    return res;
+}
+
+void lv_list_start(ListBuilder* builder) {
+
+    builder->first = NULL;
+    builder->last = NULL;
+    builder->len = 0;
+}
+
+void lv_list_push(ListBuilder* builder, TextBufferObj* obj) {
+
+    LvList* cell = newCell(obj, NULL, 0);
+    if(builder->last) {
+        cell->refCount++;
+        builder->last->tail = cell;
+    } else {
+        builder->first = cell;
+    }
+    builder->last = cell;
+    builder->len++;
+}
+
+LvList* lv_list_finish(ListBuilder* builder, LvList* rest) {
+
+    if(!builder->first)
+        return rest ? rest : lv_list_empty();
+    size_t len = builder->len + (rest ? rest->len : 0);
+    for(LvList* cell = builder->first; cell != builder->last; cell = cell->tail)
+        cell->len = len--;
+    builder->last->len = len;
+    if(rest && rest->len) {
+        rest->refCount++;
+        builder->last->tail = rest;
+    }
+    return builder->first;
+}
+
+void lv_list_free(LvList* list) {
+
+    //free iteratively so long lists do not overflow the C stack
+    while(list) {
+        assert(list->refCount == 0);
+        LvList* tail = list->tail;
+        lv_expr_cleanup(&list->head, 1);
+        lv_free(list);
+        if(tail && --tail->refCount != 0)
+            break;
+        list = tail;
+    }
+}
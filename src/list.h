@@ -0,0 +1,52 @@
+#ifndef LIST_H
+#define LIST_H
+#include "textbuffer_fwd.h"
+#include <stddef.h>
+
+/**
+ * Lavender lists are immutable singly linked lists. Consing onto a
+ * list shares it as the tail of the new list. Lists returned by these
+ * functions are new values with a refCount of 0, except where noted.
+ */
+
+/** Returns a new empty list. */
+LvList* lv_list_empty(void);
+
+/** Returns a list with the given head and tail. */
+LvList* lv_list_cons(TextBufferObj* head, LvList* tail);
+
+/**
+ * Returns the tail of a nonempty list. The tail is owned
+ * by the list, unless it is a new empty list.
+ */
+LvList* lv_list_tail(LvList* list);
+
+/** Returns the elements of a followed by the elements of b. */
+LvList* lv_list_append(LvList* a, LvList* b);
+
+/** Returns the elements of the list in reverse order. */
+LvList* lv_list_reverse(LvList* list);
+
+/**
+ * Builds a list front to back. The cells are not
+ * shared until the list is finished.
+ */
+typedef struct ListBuilder {
+    LvList* first;
+    LvList* last;
+    size_t len;
+} ListBuilder;
+
+/** Starts building a list. */
+void lv_list_start(ListBuilder* builder);
+
+/** Appends an element to the list being built. */
+void lv_list_push(ListBuilder* builder, TextBufferObj* obj);
+
+/** Returns the list built followed by the elements of rest. */
+LvList* lv_list_finish(ListBuilder* builder, LvList* rest);
+
+/** Frees a list whose refCount has reached 0. */
+void lv_list_free(LvList* list);
+
+#endif
@@ -23,6 +23,11 @@ int main(int argc, char* argv[]) {
             lv_filepath = argv[i];
         } else if(strcmp(argv[i], "-debug") == 0) {
             lv_debug = true;
+        } else if(strncmp(argv[i], "-O", 2) == 0
+            && argv[i][2] >= '0' && argv[i][2] <= '2'
+            && argv[i][3] == '\0') {
+            //-O0 to -O2 set the optimization level
+            lv_optLevel = argv[i][2] - '0';
         } else if(strcmp(argv[i], "-maxStackSize") == 0) {
             //-maxStackSize takes one argument
             if(i == (argc - 1)) {
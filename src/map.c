@@ -0,0 +1,427 @@
+#include "map.h"
+#include "textbuffer.h"
+#include "builtin.h"
+#include "expression.h"
+#include "lavender.h"
+#include <string.h>
+#include <assert.h>
+
+#define BITS 5
+#define HASH_BITS (sizeof(size_t) * 8)
+//the slot for the hash in a node at the given shift
+#define SLOT(hash, shift) (((hash) >> (shift)) & ((1 << BITS) - 1))
+
+typedef struct MapEntry {
+    size_t hash;    //hash of the key
+    TextBufferObj key;
+    TextBufferObj value;
+} MapEntry;
+
+/**
+ * A node of the trie. Each of the 32 slots of a node holds an entry,
+ * a child node, or nothing; the entries and children are stored in
+ * slot order. Nodes past the last bit of the hash have no slots and
+ * hold entries whose keys have the same hash. Nodes are shared between
+ * maps and keep a refCount of the maps and nodes referring to them.
+ */
+typedef struct MapNode MapNode;
+struct MapNode {
+    size_t refCount;
+    uint32_t datamap;   //slots holding an entry
+    uint32_t nodemap;   //slots holding a child node
+    uint32_t numEntries;
+    uint32_t numChildren;
+    MapEntry entries[]; //followed by the children
+};
+
+static MapNode** children(MapNode* node) {
+
+    return (MapNode**)&node->entries[node->numEntries];
+}
+
+/** Returns the index of the slot for bit among the slots in bitmap. */
+static int slotIndex(uint32_t bitmap, uint32_t bit) {
+
+    return __builtin_popcount(bitmap & (bit - 1));
+}
+
+static MapNode* allocNode(uint32_t numEntries, uint32_t numChildren) {
+
+    MapNode* node = lv_alloc(sizeof(MapNode)
+        + numEntries * sizeof(MapEntry)
+        + numChildren * sizeof(MapNode*));
+    node->refCount = 0;
+    node->datamap = 0;
+    node->nodemap = 0;
+    node->numEntries = numEntries;
+    node->numChildren = numChildren;
+    return node;
+}
+
+static void copyEntry(MapEntry* dst, MapEntry* src) {
+
+    *dst = *src;
+    if(dst->key.type & LV_DYNAMIC)
+        ++*dst->key.refCount;
+    if(dst->value.type & LV_DYNAMIC)
+        ++*dst->value.refCount;
+}
+
+static void releaseNode(MapNode* node) {
+
+    assert(node->refCount);
+    if(--node->refCount == 0) {
+        for(uint32_t i = 0; i < node->numEntries; i++) {
+            lv_expr_cleanup(&node->entries[i].key, 1);
+            lv_expr_cleanup(&node->entries[i].value, 1);
+        }
+        MapNode** kids = children(node);
+        for(uint32_t i = 0; i < node->numChildren; i++)
+            releaseNode(kids[i]);
+        lv_free(node);
+    }
+}
+
+static bool matches(MapEntry* entry, size_t hash, TextBufferObj* key) {
+
+    return entry->hash == hash && lv_blt_equal(&entry->key, key);
+}
+
+/** Returns the entry for the key under the given node, or NULL. */
+static MapEntry* findEntry(MapNode* node, size_t hash, TextBufferObj* key) {
+
+    for(size_t shift = 0; node; shift += BITS) {
+        if(shift >= HASH_BITS) {
+            for(uint32_t i = 0; i < node->numEntries; i++) {
+                if(matches(&node->entries[i], hash, key))
+                    return &node->entries[i];
+            }
+            return NULL;
+        }
+        uint32_t bit = 1u << SLOT(hash, shift);
+        if(node->datamap & bit) {
+            MapEntry* entry = &node->entries[slotIndex(node->datamap, bit)];
+            return matches(entry, hash, key) ? entry : NULL;
+        }
+        if(!(node->nodemap & bit))
+            return NULL;
+        node = children(node)[slotIndex(node->nodemap, bit)];
+    }
+    return NULL;
+}
+
+/**
+ * Returns a copy of the node with the slot for bit holding the given
+ * entry or child, or holding nothing if both are NULL.
+ */
+static MapNode* editNode(MapNode* node, uint32_t bit, MapEntry* entry, MapNode* child) {
+
+    uint32_t datamap = node->datamap & ~bit;
+    uint32_t nodemap = node->nodemap & ~bit;
+    if(entry)
+        datamap |= bit;
+    if(child)
+        nodemap |= bit;
+    MapNode* res = allocNode(__builtin_popcount(datamap), __builtin_popcount(nodemap));
+    res->datamap = datamap;
+    res->nodemap = nodemap;
+    uint32_t idx = 0;
+    for(uint32_t rest = datamap; rest; rest &= rest - 1) {
+        uint32_t b = rest & -rest;
+        MapEntry* src = (b == bit) ? entry : &node->entries[slotIndex(node->datamap, b)];
+        copyEntry(&res->entries[idx++], src);
+    }
+    MapNode** kids = children(res);
+    idx = 0;
+    for(uint32_t rest = nodemap; rest; rest &= rest - 1) {
+        uint32_t b = rest & -rest;
+        MapNode* src = (b == bit) ? child : children(node)[slotIndex(node->nodemap, b)];
+        src->refCount++;
+        kids[idx++] = src;
+    }
+    return res;
+}
+
+/**
+ * Returns a copy of the collision node with the i'th entry replaced
+ * by the given entry, or removed if entry is NULL. If i is the number
+ * of entries, the entry is added.
+ */
+static MapNode* editCollision(MapNode* node, uint32_t i, MapEntry* entry) {
+
+    uint32_t len = node->numEntries + (i == node->numEntries) - (entry == NULL);
+    MapNode* res = allocNode(len, 0);
+    uint32_t idx = 0;
+    for(uint32_t j = 0; j < node->numEntries; j++) {
+        if(j != i)
+            copyEntry(&res->entries[idx++], &node->entries[j]);
+        else if(entry)
+            copyEntry(&res->entries[idx++], entry);
+    }
+    if(i == node->numEntries)
+        copyEntry(&res->entries[idx], entry);
+    return res;
+}
+
+static uint32_t findCollision(MapNode* node, size_t hash, TextBufferObj* key) {
+
+    uint32_t i = 0;
+    while(i < node->numEntries && !matches(&node->entries[i], hash, key))
+        i++;
+    return i;
+}
+
+/** Returns a node at the given shift holding both entries. */
+static MapNode* pairNode(MapEntry* a, MapEntry* b, size_t shift) {
+
+    MapNode* res;
+    if(shift >= HASH_BITS) {
+        res = allocNode(2, 0);
+        copyEntry(&res->entries[0], a);
+        copyEntry(&res->entries[1], b);
+        return res;
+    }
+    uint32_t abit = 1u << SLOT(a->hash, shift);
+    uint32_t bbit = 1u << SLOT(b->hash, shift);
+    if(abit == bbit) {
+        //the entries share this slot too
+        MapNode* child = pairNode(a, b, shift + BITS);
+        res = allocNode(0, 1);
+        res->nodemap = abit;
+        child->refCount++;
+        children(res)[0] = child;
+        return res;
+    }
+    res = allocNode(2, 0);
+    res->datamap = abit | bbit;
+    if(abit > bbit) {
+        MapEntry* tmp = a;
+        a = b;
+        b = tmp;
+    }
+    copyEntry(&res->entries[0], a);
+    copyEntry(&res->entries[1], b);
+    return res;
+}
+
+/**
+ * Returns a copy of the node with the given entry, replacing the
+ * entry with an equal key if there is one. Sets added to whether
+ * the key is new.
+ */
+static MapNode* assocNode(MapNode* node, size_t shift, MapEntry* entry, bool* added) {
+
+    if(shift >= HASH_BITS) {
+        uint32_t i = findCollision(node, entry->hash, &entry->key);
+        *added = (i == node->numEntries);
+        return editCollision(node, i, entry);
+    }
+    uint32_t bit = 1u << SLOT(entry->hash, shift);
+    if(node->datamap & bit) {
+        MapEntry* old = &node->entries[slotIndex(node->datamap, bit)];
+        if(matches(old, entry->hash, &entry->key)) {
+            *added = false;
+            return editNode(node, bit, entry, NULL);
+        }
+        *added = true;
+        return editNode(node, bit, NULL, pairNode(old, entry, shift + BITS));
+    }
+    if(node->nodemap & bit) {
+        MapNode* child = children(node)[slotIndex(node->nodemap, bit)];
+        return editNode(node, bit, NULL, assocNode(child, shift + BITS, entry, added));
+    }
+    *added = true;
+    return editNode(node, bit, entry, NULL);
+}
+
+/**
+ * Returns a copy of the node without the given key, or NULL if the
+ * copy would be empty. Returns the node itself if the key is absent.
+ */
+static MapNode* dissocNode(MapNode* node, size_t shift, size_t hash, TextBufferObj* key) {
+
+    if(shift >= HASH_BITS) {
+        uint32_t i = findCollision(node, hash, key);
+        if(i == node->numEntries)
+            return node;
+        if(node->numEntries == 1)
+            return NULL;
+        return editCollision(node, i, NULL);
+    }
+    uint32_t bit = 1u << SLOT(hash, shift);
+    if(node->datamap & bit) {
+        if(!matches(&node->entries[slotIndex(node->datamap, bit)], hash, key))
+            return node;
+        if(node->numEntries == 1 && node->numChildren == 0)
+            return NULL;
+        return editNode(node, bit, NULL, NULL);
+    }
+    if(node->nodemap & bit) {
+        MapNode* child = children(node)[slotIndex(node->nodemap, bit)];
+        MapNode* res = dissocNode(child, shift + BITS, hash, key);
+        if(res == child)
+            return node;
+        if(!res) {
+            if(node->numEntries == 0 && node->numChildren == 1)
+                return NULL;
+            return editNode(node, bit, NULL, NULL);
+        }
+        if(res->numEntries == 1 && res->numChildren == 0) {
+            //move a lone entry up into this node
+            MapNode* tmp = editNode(node, bit, &res->entries[0], NULL);
+            res->refCount++;
+            releaseNode(res);
+            return tmp;
+        }
+        return editNode(node, bit, NULL, res);
+    }
+    return node;
+}
+
+typedef bool (*EntryVisitor)(MapEntry* entry, void* data);
+
+static bool visitEntries(MapNode* node, EntryVisitor visit, void* data) {
+
+    for(uint32_t i = 0; i < node->numEntries; i++) {
+        if(!visit(&node->entries[i], data))
+            return false;
+    }
+    MapNode** kids = children(node);
+    for(uint32_t i = 0; i < node->numChildren; i++) {
+        if(!visitEntries(kids[i], visit, data))
+            return false;
+    }
+    return true;
+}
+
+static LvMap* newMap(MapNode* root, size_t len) {
+
+    LvMap* map = lv_alloc(sizeof(LvMap));
+    map->refCount = 0;
+    map->hash = 0;
+    map->len = len;
+    map->root = root;
+    if(root)
+        root->refCount++;
+    return map;
+}
+
+LvMap* lv_map_new(void) {
+
+    return newMap(NULL, 0);
+}
+
+TextBufferObj* lv_map_get(LvMap* map, TextBufferObj* key) {
+
+    if(!map->root)
+        return NULL;
+    MapEntry* entry = findEntry(map->root, lv_blt_hash(key), key);
+    return entry ? &entry->value : NULL;
+}
+
+LvMap* lv_map_assoc(LvMap* map, TextBufferObj* key, TextBufferObj* value) {
+
+    MapEntry entry = { lv_blt_hash(key), *key, *value };
+    MapNode empty = { 0 };
+    bool added;
+    MapNode* root = assocNode(map->root ? map->root : &empty, 0, &entry, &added);
+    return newMap(root, map->len + added);
+}
+
+LvMap* lv_map_dissoc(LvMap* map, TextBufferObj* key) {
+
+    if(!map->root)
+        return map;
+    MapNode* root = dissocNode(map->root, 0, lv_blt_hash(key), key);
+    if(root == map->root)
+        return map;
+    return newMap(root, map->len - 1);
+}
+
+typedef struct MergeState {
+    MapNode* root;  //owned reference
+    size_t len;
+} MergeState;
+
+static bool mergeEntry(MapEntry* entry, void* data) {
+
+    MergeState* state = data;
+    bool added;
+    MapNode* root = assocNode(state->root, 0, entry, &added);
+    root->refCount++;
+    releaseNode(state->root);
+    state->root = root;
+    state->len += added;
+    return true;
+}
+
+LvMap* lv_map_merge(LvMap* a, LvMap* b) {
+
+    if(b->len == 0)
+        return a;
+    if(a->len == 0)
+        return b;
+    MergeState state = { a->root, a->len };
+    state.root->refCount++;
+    visitEntries(b->root, mergeEntry, &state);
+    LvMap* res = newMap(state.root, state.len);
+    state.root->refCount--;
+    return res;
+}
+
+typedef struct ForEachState {
+    MapVisitor visit;
+    void* data;
+} ForEachState;
+
+static bool forEachEntry(MapEntry* entry, void* data) {
+
+    ForEachState* state = data;
+    return state->visit(&entry->key, &entry->value, state->data);
+}
+
+bool lv_map_forEach(LvMap* map, MapVisitor visit, void* data) {
+
+    if(!map->root)
+        return true;
+    ForEachState state = { visit, data };
+    return visitEntries(map->root, forEachEntry, &state);
+}
+
+static bool hasEntry(MapEntry* entry, void* data) {
+
+    MapEntry* other = findEntry(data, entry->hash, &entry->key);
+    return other && lv_blt_equal(&entry->value, &other->value);
+}
+
+bool lv_map_equal(LvMap* a, LvMap* b) {
+
+    if(a->len != b->len)
+        return false;
+    if(a->len == 0)
+        return true;
+    return visitEntries(a->root, hasEntry, b->root);
+}
+
+static bool hashEntry(MapEntry* entry, void* data) {
+
+    //addition does not depend on the order of the entries
+    *(uint64_t*)data += (entry->hash * 31) ^ lv_blt_hash(&entry->value);
+    return true;
+}
+
+uint64_t lv_map_hashEntries(LvMap* map) {
+
+    uint64_t h = 0;
+    if(map->root)
+        visitEntries(map->root, hashEntry, &h);
+    return h;
+}
+
+void lv_map_free(LvMap* map) {
+
+    assert(map->refCount == 0);
+    if(map->root)
+        releaseNode(map->root);
+    lv_free(map);
+}
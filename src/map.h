@@ -0,0 +1,60 @@
+#ifndef MAP_H
+#define MAP_H
+#include "textbuffer_fwd.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Lavender maps are persistent hash array mapped tries. Updates copy
+ * the nodes on the path to the changed entry and share the rest with
+ * the original map. Maps returned by these functions are new values
+ * with a refCount of 0, except where noted.
+ */
+
+/** Returns a new empty map. */
+LvMap* lv_map_new(void);
+
+/**
+ * Returns the value associated with the given key, or NULL if
+ * the key is not in the map. The value is owned by the map.
+ */
+TextBufferObj* lv_map_get(LvMap* map, TextBufferObj* key);
+
+/** Returns a map with the given key associated with the given value. */
+LvMap* lv_map_assoc(LvMap* map, TextBufferObj* key, TextBufferObj* value);
+
+/**
+ * Returns a map without the given key. If the key is not in the
+ * map, returns the map itself.
+ */
+LvMap* lv_map_dissoc(LvMap* map, TextBufferObj* key);
+
+/**
+ * Returns a map with the entries of both maps. Where both maps
+ * have a key, the value in b is used. If either map is empty,
+ * returns the other map itself.
+ */
+LvMap* lv_map_merge(LvMap* a, LvMap* b);
+
+/**
+ * Calls the visitor with each key and value in the map, stopping
+ * early if it returns false. Returns whether every call returned
+ * true. The order of the entries is unspecified but fixed for a map.
+ */
+typedef bool (*MapVisitor)(TextBufferObj* key, TextBufferObj* value, void* data);
+bool lv_map_forEach(LvMap* map, MapVisitor visit, void* data);
+
+/** Returns whether the maps have equal keys mapped to equal values. */
+bool lv_map_equal(LvMap* a, LvMap* b);
+
+/**
+ * Combines the hashes of the entries of the map. The result
+ * does not depend on the order of the entries.
+ */
+uint64_t lv_map_hashEntries(LvMap* map);
+
+/** Frees a map whose refCount has reached 0. */
+void lv_map_free(LvMap* map);
+
+#endif
@@ -0,0 +1,323 @@
+#include "memo.h"
+#include "lavender.h"
+#include "expression.h"
+#include "operator.h"
+#include "builtin.h"
+#include "vect.h"
+#include "dynbuffer.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+
+typedef struct MemoEntry MemoEntry;
+struct MemoEntry {
+    uint64_t hash;
+    int numArgs;
+    TextBufferObj* args;    //owned references
+    TextBufferObj result;   //owned reference
+    MemoEntry* chain;       //next entry in the bucket
+    MemoEntry* newer;       //LRU order
+    MemoEntry* older;
+};
+
+struct MemoTable {
+    char* name;
+    size_t capacity;
+    size_t len;
+    size_t mask;
+    MemoEntry** buckets;
+    MemoEntry* newest;
+    MemoEntry* oldest;
+    size_t hits;
+    size_t misses;
+    MemoTable* next;
+};
+
+/** A memoized call whose result is being computed. */
+typedef struct MemoCall {
+    MemoTable* memo;
+    size_t fp;
+    uint64_t hash;
+    int numArgs;
+    TextBufferObj* args;
+} MemoCall;
+
+static MemoTable* tables;
+static DynBuffer calls; //of MemoCall
+static size_t callsFloor; //calls below this belong to other stacks
+
+static uint64_t mix(uint64_t h, uint64_t v) {
+
+    //FNV-1a style combination
+    return (h ^ v) * UINT64_C(0x100000001b3);
+}
+
+static Operator* genericFunc(Operator* func) {
+
+    return func->generic ? func->generic : func;
+}
+
+/**
+ * Returns whether the values are the same. Unlike sys:__eq__,
+ * numbers are compared by representation, since 0.0 and -0.0
+ * are equal but not interchangeable.
+ */
+static bool same(TextBufferObj* a, TextBufferObj* b) {
+
+    if(a->type != b->type)
+        return false;
+    switch(a->type) {
+        case OPT_NUMBER:
+        case OPT_INTEGER:
+            return a->integer == b->integer;
+        case OPT_STRING:
+            return a->str->len == b->str->len
+                && memcmp(a->str->value, b->str->value, a->str->len) == 0;
+        case OPT_VECT:
+            if(a->vect->len != b->vect->len)
+                return false;
+            for(size_t i = 0; i < a->vect->len; i++) {
+                TextBufferObj x = lv_vect_get(a->vect, i);
+                TextBufferObj y = lv_vect_get(b->vect, i);
+                if(!same(&x, &y))
+                    return false;
+            }
+            return true;
+        case OPT_RANGE:
+            //ranges are immutable, so compare them by value; ranges
+            //with the same elements can still have different stops
+            return a->range->len == b->range->len
+                && a->range->start == b->range->start
+                && a->range->stop == b->range->stop
+                && a->range->step == b->range->step;
+        case OPT_FUNCTION_VAL:
+            return genericFunc(a->func) == genericFunc(b->func);
+        case OPT_CAPTURE: {
+            Operator* func = a->capture->func;
+            if(genericFunc(func) != genericFunc(b->capture->func))
+                return false;
+            for(int i = 0; i < func->captureCount; i++) {
+                if(!same(&a->capture->value[i], &b->capture->value[i]))
+                    return false;
+            }
+            return true;
+        }
+        case OPT_MAP:
+        case OPT_SORTED:
+        case OPT_LIST:
+        case OPT_SEQ:
+        case OPT_COROUTINE:
+            //maps, lists, sequences, and coroutines are only the same if they are the same object
+            return a->refCount == b->refCount;
+        default:
+            return true;
+    }
+}
+
+static uint64_t hashArgs(TextBufferObj* args, int n) {
+
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    for(int i = 0; i < n; i++)
+        h = mix(h, lv_blt_hash(&args[i]));
+    return h;
+}
+
+#define MIN_BUCKETS 16
+
+MemoTable* lv_memo_new(char* name, size_t capacity) {
+
+    MemoTable* memo = lv_alloc(sizeof(MemoTable));
+    memset(memo, 0, sizeof(MemoTable));
+    memo->name = lv_alloc(strlen(name) + 1);
+    strcpy(memo->name, name);
+    memo->capacity = capacity;
+    //the buckets grow as results are added
+    size_t size = MIN_BUCKETS;
+    memo->mask = size - 1;
+    memo->buckets = lv_alloc(size * sizeof(MemoEntry*));
+    memset(memo->buckets, 0, size * sizeof(MemoEntry*));
+    memo->next = tables;
+    tables = memo;
+    if(calls.dataSize == 0)
+        lv_buf_init(&calls, sizeof(MemoCall));
+    return memo;
+}
+
+static void unlinkEntry(MemoTable* memo, MemoEntry* entry) {
+
+    if(entry->newer)
+        entry->newer->older = entry->older;
+    else
+        memo->newest = entry->older;
+    if(entry->older)
+        entry->older->newer = entry->newer;
+    else
+        memo->oldest = entry->newer;
+}
+
+static void linkNewest(MemoTable* memo, MemoEntry* entry) {
+
+    entry->newer = NULL;
+    entry->older = memo->newest;
+    if(memo->newest)
+        memo->newest->newer = entry;
+    else
+        memo->oldest = entry;
+    memo->newest = entry;
+}
+
+static void freeEntry(MemoEntry* entry) {
+
+    lv_expr_cleanup(entry->args, entry->numArgs);
+    lv_expr_cleanup(&entry->result, 1);
+    lv_free(entry->args);
+    lv_free(entry);
+}
+
+/** Doubles the number of buckets, keeping the table at most half full. */
+static void grow(MemoTable* memo) {
+
+    size_t size = (memo->mask + 1) * 2;
+    MemoEntry** buckets = lv_alloc(size * sizeof(MemoEntry*));
+    memset(buckets, 0, size * sizeof(MemoEntry*));
+    for(MemoEntry* entry = memo->newest; entry; entry = entry->older) {
+        MemoEntry** bucket = &buckets[entry->hash & (size - 1)];
+        entry->chain = *bucket;
+        *bucket = entry;
+    }
+    lv_free(memo->buckets);
+    memo->buckets = buckets;
+    memo->mask = size - 1;
+}
+
+/** Evicts the least recently used entry. */
+static void evict(MemoTable* memo) {
+
+    MemoEntry* entry = memo->oldest;
+    unlinkEntry(memo, entry);
+    MemoEntry** pos = &memo->buckets[entry->hash & memo->mask];
+    while(*pos != entry)
+        pos = &(*pos)->chain;
+    *pos = entry->chain;
+    memo->len--;
+    freeEntry(entry);
+}
+
+bool lv_memo_get(MemoTable* memo, TextBufferObj* args, int n, TextBufferObj* res) {
+
+    uint64_t hash = hashArgs(args, n);
+    for(MemoEntry* entry = memo->buckets[hash & memo->mask]; entry; entry = entry->chain) {
+        if(entry->hash != hash || entry->numArgs != n)
+            continue;
+        bool match = true;
+        for(int i = 0; i < n && match; i++)
+            match = same(&args[i], &entry->args[i]);
+        if(match) {
+            unlinkEntry(memo, entry);
+            linkNewest(memo, entry);
+            memo->hits++;
+            *res = entry->result;
+            return true;
+        }
+    }
+    memo->misses++;
+    return false;
+}
+
+void lv_memo_enter(MemoTable* memo, TextBufferObj* args, int n, size_t fp) {
+
+    MemoCall call = { memo, fp, hashArgs(args, n), n, lv_alloc(n * sizeof(TextBufferObj)) };
+    memcpy(call.args, args, n * sizeof(TextBufferObj));
+    for(int i = 0; i < n; i++) {
+        if(args[i].type & LV_DYNAMIC)
+            ++*args[i].refCount;
+    }
+    lv_buf_push(&calls, &call);
+}
+
+void lv_memo_leave(size_t fp, TextBufferObj* res) {
+
+    if(calls.len <= callsFloor)
+        return;
+    MemoCall* call = lv_buf_get(&calls, calls.len - 1);
+    if(call->fp != fp)
+        return;
+    MemoTable* memo = call->memo;
+    if(memo->len == memo->capacity)
+        evict(memo);
+    else if(memo->len * 2 >= memo->mask + 1)
+        grow(memo);
+    MemoEntry* entry = lv_alloc(sizeof(MemoEntry));
+    entry->hash = call->hash;
+    entry->numArgs = call->numArgs;
+    entry->args = call->args;
+    entry->result = *res;
+    if(res->type & LV_DYNAMIC)
+        ++*res->refCount;
+    MemoEntry** bucket = &memo->buckets[entry->hash & memo->mask];
+    entry->chain = *bucket;
+    *bucket = entry;
+    linkNewest(memo, entry);
+    memo->len++;
+    calls.len--;
+}
+
+size_t lv_memo_switchStack(void) {
+
+    size_t floor = callsFloor;
+    callsFloor = calls.len;
+    return floor;
+}
+
+void lv_memo_switchBack(size_t floor) {
+
+    while(calls.len > callsFloor) {
+        MemoCall call;
+        lv_buf_pop(&calls, &call);
+        lv_expr_cleanup(call.args, call.numArgs);
+        lv_free(call.args);
+    }
+    callsFloor = floor;
+}
+
+void lv_memo_setCapacity(MemoTable* memo, size_t capacity) {
+
+    memo->capacity = capacity;
+    while(memo->len > capacity)
+        evict(memo);
+}
+
+static void clear(MemoTable* memo) {
+
+    while(memo->len > 0)
+        evict(memo);
+}
+
+void lv_memo_clearAll(void) {
+
+    for(MemoTable* memo = tables; memo; memo = memo->next)
+        clear(memo);
+}
+
+void lv_memo_onShutdown(void) {
+
+    while(tables) {
+        MemoTable* memo = tables;
+        if(lv_debug) {
+            printf("Memo %s: %zu hits, %zu misses\n",
+                memo->name, memo->hits, memo->misses);
+        }
+        clear(memo);
+        tables = memo->next;
+        lv_free(memo->buckets);
+        lv_free(memo->name);
+        lv_free(memo);
+    }
+    for(size_t i = 0; i < calls.len; i++) {
+        MemoCall* call = lv_buf_get(&calls, i);
+        lv_expr_cleanup(call->args, call->numArgs);
+        lv_free(call->args);
+    }
+    lv_free(calls.data);
+}
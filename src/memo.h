@@ -0,0 +1,70 @@
+#ifndef MEMO_H
+#define MEMO_H
+#include "textbuffer_fwd.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * A bounded table of the results of a pure function, keyed on the
+ * structure of its args. The least recently used result is evicted
+ * when the table is full.
+ */
+typedef struct MemoTable MemoTable;
+
+/** The most results a memo table may hold. */
+#define LV_MEMO_MAX_CAPACITY ((size_t)1 << 24)
+
+/**
+ * Creates a memo table for the function with the given name holding
+ * at most capacity results. Tables are freed on shutdown.
+ */
+MemoTable* lv_memo_new(char* name, size_t capacity);
+
+/**
+ * Changes the number of results the table may hold, evicting the
+ * least recently used results that no longer fit.
+ */
+void lv_memo_setCapacity(MemoTable* memo, size_t capacity);
+
+/**
+ * Looks up the result for the n given args. On a hit, sets res to the
+ * result, which is owned by the table, and returns true.
+ */
+bool lv_memo_get(MemoTable* memo, TextBufferObj* args, int n, TextBufferObj* res);
+
+/**
+ * Starts computing the result for the n given args in the frame
+ * beginning at fp. The result is stored when that frame returns.
+ */
+void lv_memo_enter(MemoTable* memo, TextBufferObj* args, int n, size_t fp);
+
+/**
+ * Called when the frame beginning at fp returns the given value.
+ * Stores the value if it is the result of a memoized call.
+ */
+void lv_memo_leave(size_t fp, TextBufferObj* res);
+
+/**
+ * Called when the VM switches to the stack of a coroutine. Frames on
+ * different stacks may have the same frame pointer, so calls entered
+ * before the switch are not left until lv_memo_switchBack is called
+ * with the returned value.
+ */
+size_t lv_memo_switchStack(void);
+
+/**
+ * Called when the VM switches back from the stack of a coroutine.
+ * Calls entered since the switch are abandoned, since a suspended
+ * coroutine may be resumed any number of times or not at all.
+ */
+void lv_memo_switchBack(size_t floor);
+
+/**
+ * Empties every memo table. Cached args may refer to functions
+ * that are about to be freed.
+ */
+void lv_memo_clearAll(void);
+
+void lv_memo_onShutdown(void);
+
+#endif
@@ -1,18 +1,33 @@
 #include "operator.h"
 #include "lavender.h"
 #include "hashtable.h"
+#include "memo.h"
+#include "dynbuffer.h"
 #include <string.h>
+#include <stdio.h>
 #include <assert.h>
 
 static Hashtable funcNamespaces[FNS_COUNT];
 //storing anonymous functions
 static Operator* anonFuncs;
+//specializations, keyed by function, param, and value
+static Hashtable specializations;
+//operators created while marked, so they can be released
+static int openMarks;
+static DynBuffer markedSpecs;   //of char* (key in specializations)
+typedef struct MarkedName {
+    char* name;
+    FuncNamespace ns;
+} MarkedName;
+static DynBuffer markedNames;   //of MarkedName
 
 //destructor function for funcNamespaces
 static void freeFuncNamespaces(char* key, void* value) {
 
     lv_free(key);
     Operator* op = (Operator*) value;
+    lv_free(op->captures);
+    lv_free(op->paramTypes);
     if(op->type == FUN_FWD_DECL) {
         //free param names
         Param* params = op->params;
@@ -55,7 +70,14 @@ bool lv_op_addOperator(Operator* op, FuncNamespace ns) {
         anonFuncs = op;
         return true;
     }
-    return lv_tbl_put(&funcNamespaces[ns], op->name, op);
+    if(!lv_tbl_put(&funcNamespaces[ns], op->name, op))
+        return false;
+    if(openMarks > 0) {
+        MarkedName marked = { lv_alloc(strlen(op->name) + 1), ns };
+        strcpy(marked.name, op->name);
+        lv_buf_push(&markedNames, &marked);
+    }
+    return true;
 }
 
 bool lv_op_removeOperator(char* name, FuncNamespace ns) {
@@ -67,9 +89,90 @@ bool lv_op_removeOperator(char* name, FuncNamespace ns) {
     return removed != NULL;
 }
 
+int lv_op_getCapturedParam(Operator* func, Operator* scope, int param) {
+
+    if(func == scope)
+        return param;
+    if(func->captureCount == 0)
+        return -1;
+    param = lv_op_getCapturedParam(func->enclosing, scope, param);
+    //captured params come after the formal params
+    int formal = func->arity - func->captureCount;
+    for(int i = 0; i < func->captureCount; i++) {
+        if(func->captures[i] == param)
+            return formal + i;
+    }
+    return -1;
+}
+
+//builds the key of a specialization
+static char* specKey(Operator* func, int param, Operator* value) {
+
+    //enough for two pointers and an int
+    char* key = lv_alloc(64);
+    snprintf(key, 64, "%p:%d:%p", (void*)func, param, (void*)value);
+    return key;
+}
+
+Operator* lv_op_getSpecialization(Operator* func, int param, Operator* value) {
+
+    char* key = specKey(func, param, value);
+    Operator* res = lv_tbl_get(&specializations, key);
+    lv_free(key);
+    return res;
+}
+
+void lv_op_addSpecialization(Operator* spec, Operator* func, int param, Operator* value) {
+
+    char* key = specKey(func, param, value);
+    lv_tbl_put(&specializations, key, spec);
+    if(openMarks > 0)
+        lv_buf_push(&markedSpecs, &key);
+    //freed with the anonymous functions
+    spec->next = anonFuncs;
+    anonFuncs = spec;
+}
+
+//builds the key of a specialization for the types of the params
+static char* typedSpecKey(Operator* func, unsigned* types) {
+
+    //enough for a pointer and a type per param
+    size_t len = 32 + func->arity * 9;
+    char* key = lv_alloc(len);
+    int pos = snprintf(key, len, "%p:t", (void*)func);
+    for(int i = 0; i < func->arity; i++)
+        pos += snprintf(key + pos, len - pos, ":%x", types[i]);
+    return key;
+}
+
+Operator* lv_op_getTypedSpecialization(Operator* func, unsigned* types) {
+
+    char* key = typedSpecKey(func, types);
+    Operator* res = lv_tbl_get(&specializations, key);
+    lv_free(key);
+    return res;
+}
+
+void lv_op_addTypedSpecialization(Operator* spec, Operator* func, unsigned* types) {
+
+    char* key = typedSpecKey(func, types);
+    lv_tbl_put(&specializations, key, spec);
+    if(openMarks > 0)
+        lv_buf_push(&markedSpecs, &key);
+    spec->next = anonFuncs;
+    anonFuncs = spec;
+}
+
+static void freeSpecKey(char* key, void* value) {
+
+    lv_free(key);
+}
+
 static void freeOp(Operator* op) {
 
     lv_free(op->name);
+    lv_free(op->captures);
+    lv_free(op->paramTypes);
     if(op->type == FUN_FWD_DECL) {
         //free param names
         Param* params = op->params;
@@ -91,16 +194,60 @@ static void freeList(Operator* head) {
     }
 }
 
+OpMark lv_op_mark(void) {
+
+    openMarks++;
+    OpMark mark = { anonFuncs, markedSpecs.len, markedNames.len };
+    return mark;
+}
+
+void lv_op_release(OpMark mark) {
+
+    assert(openMarks > 0);
+    if(anonFuncs != mark.anonFuncs || markedNames.len > mark.names) {
+        //cached values may refer to the functions being freed
+        lv_memo_clearAll();
+    }
+    while(markedNames.len > mark.names) {
+        MarkedName marked;
+        lv_buf_pop(&markedNames, &marked);
+        lv_op_removeOperator(marked.name, marked.ns);
+        lv_free(marked.name);
+    }
+    while(markedSpecs.len > mark.specs) {
+        char* key;
+        lv_buf_pop(&markedSpecs, &key);
+        lv_tbl_del(&specializations, key, NULL);
+        lv_free(key);
+    }
+    //anonymous functions and specializations are both in the list
+    while(anonFuncs != mark.anonFuncs) {
+        Operator* tmp = anonFuncs->next;
+        freeOp(anonFuncs);
+        anonFuncs = tmp;
+    }
+    openMarks--;
+}
+
 void lv_op_onStartup(void) {
 
     for(int i = 0; i < FNS_COUNT; i++) {
         lv_tbl_init(&funcNamespaces[i]);
     }
+    lv_tbl_init(&specializations);
+    lv_buf_init(&markedSpecs, sizeof(char*));
+    lv_buf_init(&markedNames, sizeof(MarkedName));
 }
 
 void lv_op_onShutdown(void) {
 
     freeList(anonFuncs);
+    for(size_t i = 0; i < markedNames.len; i++)
+        lv_free(((MarkedName*)lv_buf_get(&markedNames, i))->name);
+    lv_free(markedNames.data);
+    lv_free(markedSpecs.data);
+    lv_tbl_clear(&specializations, freeSpecKey);
+    lv_free(specializations.table);
     for(int i = 0; i < FNS_COUNT; i++) {
         lv_tbl_clear(&funcNamespaces[i], freeFuncNamespaces);
         lv_free(funcNamespaces[i].table);
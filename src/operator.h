@@ -5,6 +5,7 @@
 #include "token.h"
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 struct Param {
     char* name;
@@ -14,6 +15,12 @@ struct Param {
 
 typedef TextBufferObj (*Builtin)(TextBufferObj*);
 
+typedef enum ObjectLike {
+    OBJ_UNKNOWN,    //not computed yet
+    OBJ_NO,
+    OBJ_YES
+} ObjectLike;
+
 /**
  * A struct that stores a Lavender function and its name.
  * These values are stored in a global hashtable.
@@ -24,6 +31,8 @@ struct Operator {
     int arity;
     Fixing fixing;
     int captureCount;
+    int* captures;  //index of each captured param in the enclosing function
+    Operator* enclosing;    //enclosing function (if anything is captured)
     int locals;
     union {
         int textOffset;
@@ -32,6 +41,13 @@ struct Operator {
     };
     Operator* next; //used by anonFuncs
     bool varargs;
+    uint64_t byName;    //bitset of formal params passed by name
+    uint64_t strict;    //bitset of by name params always evaluated
+    ObjectLike objectLike;  //whether the function value is object-like
+    Operator* generic;  //function this is a specialization of, or NULL
+    unsigned* paramTypes;   //types each param is known to have, or NULL (see expr_types.c)
+    int typedSpecs;     //number of specializations for the types of the params
+    struct MemoTable* memo; //results of previous calls, or NULL (see memo.h)
 };
 
 /**
@@ -61,6 +77,53 @@ bool lv_op_addOperator(Operator* op, FuncNamespace ns);
  */
 bool lv_op_removeOperator(char* name, FuncNamespace ns);
 
+/**
+ * Returns the index of the given param of the function scope in
+ * the params of func, or -1 if func does not have access to it.
+ * The function scope must be func or a function func is nested in.
+ */
+int lv_op_getCapturedParam(Operator* func, Operator* scope, int param);
+
+/**
+ * Returns the specialization of func for the given constant
+ * function value of param, or NULL if there is none.
+ */
+Operator* lv_op_getSpecialization(Operator* func, int param, Operator* value);
+
+/**
+ * Adds spec as the specialization of func for the given constant
+ * function value of param. Specializations are not in any namespace,
+ * but are freed with the other operators.
+ */
+void lv_op_addSpecialization(Operator* spec, Operator* func, int param, Operator* value);
+
+/**
+ * Returns the specialization of func for the given types of its
+ * params, or NULL if there is none. There is one type per param,
+ * as a set of the types tracked by the type inference pass.
+ */
+Operator* lv_op_getTypedSpecialization(Operator* func, unsigned* types);
+
+/**
+ * Adds spec as the specialization of func for the given types of
+ * its params. It is freed like other specializations.
+ */
+void lv_op_addTypedSpecialization(Operator* spec, Operator* func, unsigned* types);
+
+/**
+ * A point in the creation of operators. The anonymous functions,
+ * named functions, and specializations created after the mark are
+ * freed together by lv_op_release once nothing refers to them.
+ */
+typedef struct OpMark {
+    Operator* anonFuncs;    //most recent anonymous function
+    size_t specs;           //number of specializations logged
+    size_t names;           //number of named functions logged
+} OpMark;
+
+OpMark lv_op_mark(void);
+void lv_op_release(OpMark mark);
+
 /**
  * Retrieves all operators in the specified scope.
  */
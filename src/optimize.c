@@ -0,0 +1,175 @@
+#include "optimize.h"
+#include "lavender.h"
+#include "expression.h"
+#include "operator.h"
+#include "builtin.h"
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * An optimization pass over the code of a single function, which it
+ * patches in place in the text buffer. A pass returns the number of
+ * instructions it changed or removed.
+ */
+typedef struct Pass {
+    char* name;
+    int level;              //lowest optimization level the pass runs at
+    bool specializations;   //whether the pass runs on specializations
+    int (*run)(Operator* func);
+    double time;            //total time spent in ms
+    long changed;           //total instructions changed
+} Pass;
+
+/**
+ * Points each branch of the function that targets an unconditional
+ * jump at the final target instead.
+ */
+static int threadJumps(Operator* func) {
+
+    int changed = 0;
+    size_t pc = func->textOffset;
+    while(true) {
+        //pieces are straight line code up to their branch
+        while(TEXT_BUFFER[pc].type != OPT_BEQZ
+            && TEXT_BUFFER[pc].type != OPT_JUMP
+            && TEXT_BUFFER[pc].type != OPT_RETURN)
+            pc++;
+        if(TEXT_BUFFER[pc].type == OPT_RETURN)
+            break;
+        size_t target = pc + TEXT_BUFFER[pc].branchAddr;
+        while(TEXT_BUFFER[target].type == OPT_JUMP)
+            target += TEXT_BUFFER[target].branchAddr;
+        if(target != pc + TEXT_BUFFER[pc].branchAddr) {
+            TEXT_BUFFER[pc].branchAddr = target - pc;
+            changed++;
+        }
+        pc = target;
+    }
+    return changed;
+}
+
+/**
+ * Returns whether the instruction pushes a param or a constant.
+ */
+static bool isOperand(TextBufferObj* obj) {
+
+    switch(obj->type) {
+        case OPT_PARAM:
+        case OPT_UNDEFINED:
+        case OPT_NUMBER:
+        case OPT_INTEGER:
+        case OPT_STRING:
+        case OPT_VECT:
+            return true;
+        case OPT_FUNCTION_VAL:
+            //functions with captures are followed by OPT_FUNC_CAP
+            return obj->func->captureCount == 0;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Replaces builtin calls in the code from pc up to end whose first
+ * operand is a param and whose other operands are params or constants.
+ */
+static int callsInRange(size_t pc, size_t end) {
+
+    int changed = 0;
+    for(size_t i = pc; i < end; i++) {
+        TextBufferObj* obj = &TEXT_BUFFER[i];
+        if(obj->type != OPT_FUNCTION || obj->func->type != FUN_BUILTIN)
+            continue;
+        //the param keeps its reference, so it would not look shared
+        if(lv_blt_isInPlace(obj->func))
+            continue;
+        int arity = obj->func->arity;
+        if(arity == 0 || i - pc < (size_t)arity)
+            continue;
+        TextBufferObj* first = obj - arity;
+        bool operands = first->type == OPT_PARAM;
+        for(int j = 1; operands && j < arity; j++)
+            operands = isOperand(first + j);
+        if(operands) {
+            int param = first->param;
+            first->type = OPT_REG_CALL;
+            first->regParam = param;
+            first->regArgs = arity;
+            changed += arity;
+        }
+    }
+    return changed;
+}
+
+/**
+ * Calls builtins with operands read directly from the frame and the
+ * code instead of pushed on the stack, where the operands allow. The
+ * original operands stay in place after OPT_REG_CALL, so branching
+ * into the middle of the call and passes reading the code still see
+ * the stack code.
+ */
+static int registerCalls(Operator* func) {
+
+    int changed = 0;
+    size_t pc = func->textOffset;
+    while(true) {
+        size_t branch = pc;
+        while(TEXT_BUFFER[branch].type != OPT_BEQZ
+            && TEXT_BUFFER[branch].type != OPT_JUMP
+            && TEXT_BUFFER[branch].type != OPT_RETURN)
+            branch++;
+        changed += callsInRange(pc, branch);
+        if(TEXT_BUFFER[branch].type == OPT_RETURN)
+            break;
+        if(TEXT_BUFFER[branch].type == OPT_BEQZ) {
+            //the body of the piece
+            size_t ret = branch + 1;
+            while(TEXT_BUFFER[ret].type != OPT_RETURN)
+                ret++;
+            changed += callsInRange(branch + 1, ret);
+        }
+        pc = branch + TEXT_BUFFER[branch].branchAddr;
+    }
+    return changed;
+}
+
+static Pass passes[] = {
+    { "jumps", 1, true, threadJumps },
+    { "specialize", 2, false, lv_tb_specializeCalls },
+    { "types", 1, true, lv_expr_inferTypes },
+    { "registers", 2, true, registerCalls },
+};
+
+#define NUM_PASSES (sizeof(passes) / sizeof(passes[0]))
+
+void lv_opt_optimize(Operator* func) {
+
+    for(size_t i = 0; i < NUM_PASSES; i++) {
+        Pass* pass = &passes[i];
+        if(lv_optLevel < pass->level || (func->generic && !pass->specializations))
+            continue;
+        clock_t start = clock();
+        int changed = pass->run(func);
+        double time = (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+        pass->time += time;
+        pass->changed += changed;
+        if(lv_debug) {
+            printf("Pass %s on %s: %d changed, %.3f ms\n",
+                pass->name, func->name, changed, time);
+        }
+    }
+}
+
+void lv_opt_onShutdown(void) {
+
+    if(!lv_debug)
+        return;
+    //print the totals of each pass
+    for(size_t i = 0; i < NUM_PASSES; i++) {
+        Pass* pass = &passes[i];
+        if(lv_optLevel < pass->level)
+            continue;
+        printf("Pass %s total: %ld changed, %.3f ms\n",
+            pass->name, pass->changed, pass->time);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+#include "operator_fwd.h"
+
+/**
+ * The -O pass manager. Passes rewrite the code of a function in place
+ * in the text buffer, treating each piece of the function (straight
+ * line code up to its branch) as a basic block. There is no separate
+ * IR that code is lowered into and raised back from; passes which need
+ * control flow beyond a single function's pieces are left until there is.
+ */
+
+/**
+ * Runs the optimization passes enabled at the current optimization
+ * level over the code of the given function. Specializations of a
+ * function only run the passes that apply to them.
+ */
+void lv_opt_optimize(Operator* func);
+
+void lv_opt_onShutdown(void);
+
+#endif
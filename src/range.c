@@ -0,0 +1,58 @@
+#include "range.h"
+#include "lavender.h"
+#include <assert.h>
+
+static inline bool isNegative(uint64_t repr) {
+
+    return repr >> 63;
+}
+
+LvRange* lv_range_new(uint64_t start, uint64_t stop, uint64_t step) {
+
+    if(step == 0)
+        return NULL;
+    //unsigned differences are exact when the signed values are ordered
+    size_t len = 0;
+    if(!isNegative(step) && (int64_t)start < (int64_t)stop) {
+        len = (stop - start - 1) / step + 1;
+    } else if(isNegative(step) && (int64_t)start > (int64_t)stop) {
+        len = (start - stop - 1) / -step + 1;
+    }
+    //lengths are ints in Lavender, so reject spans too long to index
+    if(len > INT64_MAX)
+        return NULL;
+    LvRange* range = lv_alloc(sizeof(LvRange));
+    range->refCount = 0;
+    range->hash = 0;
+    range->len = len;
+    range->start = start;
+    range->stop = stop;
+    range->step = step;
+    return range;
+}
+
+bool lv_range_has(LvRange* range, TextBufferObj* val) {
+
+    if(val->type != OPT_INTEGER || range->len == 0)
+        return false;
+    //the offset from start in units of step, if it is whole
+    uint64_t offset = isNegative(range->step) ? range->start - val->integer : val->integer - range->start;
+    uint64_t step = isNegative(range->step) ? -range->step : range->step;
+    if(isNegative(range->step) ? (int64_t)val->integer > (int64_t)range->start
+                               : (int64_t)val->integer < (int64_t)range->start)
+        return false;
+    return offset % step == 0 && offset / step < range->len;
+}
+
+LvRange* lv_range_slice(LvRange* range, size_t start, size_t end) {
+
+    assert(start <= end && end <= range->len);
+    LvRange* res = lv_alloc(sizeof(LvRange));
+    res->refCount = 0;
+    res->hash = 0;
+    res->len = end - start;
+    res->start = lv_range_at(range, start);
+    res->stop = lv_range_at(range, end);
+    res->step = range->step;
+    return res;
+}
@@ -0,0 +1,37 @@
+#ifndef RANGE_H
+#define RANGE_H
+#include "textbuffer.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Lavender ranges are immutable arithmetic sequences of ints, stored
+ * as their start, step, and length rather than their elements.
+ * Ranges returned by these functions are new values with a refCount
+ * of 0.
+ */
+
+/**
+ * Returns the range of ints from start up to but not including stop,
+ * counting by step, or NULL if step is 0. If step is negative, the
+ * range counts down to stop instead.
+ */
+LvRange* lv_range_new(uint64_t start, uint64_t stop, uint64_t step);
+
+/** Returns the element at the given index, which must be in bounds. */
+static inline uint64_t lv_range_at(LvRange* range, size_t idx) {
+
+    return range->start + idx * range->step;
+}
+
+/** Returns whether the value is an int in the range. */
+bool lv_range_has(LvRange* range, TextBufferObj* val);
+
+/**
+ * Returns the elements at the indices from start up to but not
+ * including end, which must be in bounds.
+ */
+LvRange* lv_range_slice(LvRange* range, size_t start, size_t end);
+
+#endif
@@ -0,0 +1,353 @@
+#include "seq.h"
+#include "textbuffer.h"
+#include "expression.h"
+#include "builtin.h"
+#include "vect.h"
+#include "range.h"
+#include "coroutine.h"
+#include "lavender.h"
+#include <assert.h>
+
+struct SeqIter {
+    LvSeq* seq;
+    SeqIter* src;       //iterator over the source, or the first of zip and concat
+    SeqIter* other;     //iterator over the second of zip and concat, or the current flatmap result
+    TextBufferObj state;    //current seed of iterate, or copy of a coroutine
+    LvList* cell;       //next cell of a list
+    uint64_t pos;       //index of the next element or int, or elements pulled by slice
+    bool started;       //whether iterate or coroutine has yielded its first value, or concat finished src
+    bool done;          //whether the iteration has ended
+};
+
+static void incRefCount(TextBufferObj* obj) {
+
+    if(obj->type & LV_DYNAMIC)
+        ++*obj->refCount;
+}
+
+static LvSeq* newSeq(SeqKind kind, LvSeq* src) {
+
+    LvSeq* seq = lv_alloc(sizeof(LvSeq));
+    seq->refCount = 0;
+    seq->kind = kind;
+    seq->src = src;
+    if(src)
+        src->refCount++;
+    seq->other = NULL;
+    seq->value.type = OPT_UNDEFINED;
+    seq->func.type = OPT_UNDEFINED;
+    seq->start = seq->stop = 0;
+    seq->bounded = false;
+    return seq;
+}
+
+LvSeq* lv_seq_of(TextBufferObj* obj) {
+
+    SeqKind kind;
+    switch(obj->type) {
+        case OPT_VECT: kind = SEQ_VECT; break;
+        case OPT_LIST: kind = SEQ_LIST; break;
+        case OPT_STRING: kind = SEQ_STRING; break;
+        case OPT_RANGE: kind = SEQ_RANGE; break;
+        case OPT_COROUTINE: kind = SEQ_COROUTINE; break;
+        case OPT_SEQ: return obj->seq;
+        default: return NULL;
+    }
+    LvSeq* seq = newSeq(kind, NULL);
+    seq->value = *obj;
+    seq->bounded = kind == SEQ_RANGE;
+    incRefCount(&seq->value);
+    return seq;
+}
+
+LvSeq* lv_seq_from(uint64_t start) {
+
+    LvSeq* seq = newSeq(SEQ_RANGE, NULL);
+    seq->start = start;
+    return seq;
+}
+
+LvSeq* lv_seq_iterate(TextBufferObj* seed, TextBufferObj* func) {
+
+    LvSeq* seq = newSeq(SEQ_ITERATE, NULL);
+    seq->value = *seed;
+    seq->func = *func;
+    incRefCount(&seq->value);
+    incRefCount(&seq->func);
+    return seq;
+}
+
+LvSeq* lv_seq_apply(SeqKind kind, LvSeq* src, TextBufferObj* func) {
+
+    assert(kind == SEQ_MAP || kind == SEQ_FILTER || kind == SEQ_WHILE || kind == SEQ_FLATMAP);
+    LvSeq* seq = newSeq(kind, src);
+    seq->value = *func;
+    incRefCount(&seq->value);
+    return seq;
+}
+
+LvSeq* lv_seq_slice(LvSeq* src, uint64_t start, uint64_t stop, bool bounded) {
+
+    LvSeq* seq = newSeq(SEQ_SLICE, src);
+    seq->start = start;
+    seq->stop = stop;
+    seq->bounded = bounded;
+    return seq;
+}
+
+LvSeq* lv_seq_join(SeqKind kind, LvSeq* src, LvSeq* other) {
+
+    assert(kind == SEQ_ZIP || kind == SEQ_CONCAT);
+    LvSeq* seq = newSeq(kind, src);
+    seq->other = other;
+    other->refCount++;
+    return seq;
+}
+
+SeqIter* lv_seq_iter(LvSeq* seq) {
+
+    SeqIter* iter = lv_alloc(sizeof(SeqIter));
+    iter->seq = seq;
+    seq->refCount++;
+    iter->src = seq->src ? lv_seq_iter(seq->src) : NULL;
+    iter->other = seq->other ? lv_seq_iter(seq->other) : NULL;
+    iter->state.type = OPT_UNDEFINED;
+    iter->cell = NULL;
+    iter->pos = 0;
+    iter->started = false;
+    iter->done = false;
+    switch(seq->kind) {
+        case SEQ_LIST:
+            iter->cell = seq->value.list->len ? seq->value.list : NULL;
+            break;
+        case SEQ_ITERATE:
+            iter->state = seq->value;
+            incRefCount(&iter->state);
+            break;
+        case SEQ_COROUTINE: {
+            //resume a copy, so the sequence can be iterated again
+            LvCoroutine* co = lv_coroutine_copy(seq->value.coroutine);
+            if(co) {
+                co->refCount++;
+                iter->state.type = OPT_COROUTINE;
+                iter->state.coroutine = co;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return iter;
+}
+
+/** Calls the predicate on the element and returns the result as a bool. */
+static bool test(TextBufferObj* pred, TextBufferObj* elem) {
+
+    TextBufferObj res;
+    lv_callFunction(pred, 1, elem, &res);
+    incRefCount(&res);
+    bool pass = lv_blt_toBool(&res);
+    lv_expr_cleanup(&res, 1);
+    return pass;
+}
+
+/** Pulls the next element through the stage of the iterator. */
+static bool next(SeqIter* iter, TextBufferObj* elem) {
+
+    LvSeq* seq = iter->seq;
+    switch(seq->kind) {
+        case SEQ_VECT: {
+            LvVect* vect = seq->value.vect;
+            if(iter->pos == vect->len)
+                return false;
+            *elem = lv_vect_get(vect, iter->pos++);
+            incRefCount(elem);
+            return true;
+        }
+        case SEQ_LIST:
+            if(!iter->cell)
+                return false;
+            *elem = iter->cell->head;
+            incRefCount(elem);
+            iter->cell = iter->cell->tail;
+            return true;
+        case SEQ_STRING: {
+            LvString* str = seq->value.str;
+            if(iter->pos == str->len)
+                return false;
+            LvString* chr = lv_alloc(sizeof(LvString) + 2);
+            chr->refCount = 1;
+            chr->hash = 0;
+            chr->len = 1;
+            chr->value[0] = str->value[iter->pos++];
+            chr->value[1] = '\0';
+            elem->type = OPT_STRING;
+            elem->str = chr;
+            return true;
+        }
+        case SEQ_RANGE:
+            elem->type = OPT_INTEGER;
+            if(!seq->bounded) {
+                elem->integer = seq->start + iter->pos++;
+                return true;
+            }
+            if(iter->pos == seq->value.range->len)
+                return false;
+            elem->integer = lv_range_at(seq->value.range, iter->pos++);
+            return true;
+        case SEQ_ITERATE:
+            //the next seed is only computed when it is needed
+            if(iter->started) {
+                TextBufferObj seed;
+                lv_callFunction(&seq->func, 1, &iter->state, &seed);
+                incRefCount(&seed);
+                lv_expr_cleanup(&iter->state, 1);
+                iter->state = seed;
+            }
+            iter->started = true;
+            *elem = iter->state;
+            incRefCount(elem);
+            return true;
+        case SEQ_COROUTINE: {
+            if(iter->state.type != OPT_COROUTINE)
+                return false;
+            LvCoroutine* co = iter->state.coroutine;
+            //a suspended coroutine has already yielded its first value
+            if(iter->started || co->state != CO_SUSPENDED) {
+                TextBufferObj input = { .type = OPT_UNDEFINED };
+                lv_resumeCoroutine(co, &input);
+            }
+            iter->started = true;
+            if(co->state != CO_SUSPENDED)
+                return false;
+            *elem = co->value;
+            incRefCount(elem);
+            return true;
+        }
+        case SEQ_MAP: {
+            TextBufferObj val;
+            if(!lv_seq_next(iter->src, &val))
+                return false;
+            lv_callFunction(&seq->value, 1, &val, elem);
+            incRefCount(elem);
+            lv_expr_cleanup(&val, 1);
+            return true;
+        }
+        case SEQ_FILTER:
+            while(lv_seq_next(iter->src, elem)) {
+                if(test(&seq->value, elem))
+                    return true;
+                lv_expr_cleanup(elem, 1);
+            }
+            return false;
+        case SEQ_WHILE:
+            if(!lv_seq_next(iter->src, elem))
+                return false;
+            if(test(&seq->value, elem))
+                return true;
+            lv_expr_cleanup(elem, 1);
+            return false;
+        case SEQ_FLATMAP:
+            while(true) {
+                if(iter->other) {
+                    if(lv_seq_next(iter->other, elem))
+                        return true;
+                    lv_seq_endIter(iter->other);
+                    iter->other = NULL;
+                }
+                TextBufferObj val;
+                if(!lv_seq_next(iter->src, &val))
+                    return false;
+                lv_callFunction(&seq->value, 1, &val, elem);
+                incRefCount(elem);
+                lv_expr_cleanup(&val, 1);
+                LvSeq* inner = lv_seq_of(elem);
+                if(!inner)
+                    return true;
+                iter->other = lv_seq_iter(inner);
+                lv_expr_cleanup(elem, 1);
+            }
+        case SEQ_SLICE:
+            for(; iter->pos < seq->start; iter->pos++) {
+                if(!lv_seq_next(iter->src, elem))
+                    return false;
+                lv_expr_cleanup(elem, 1);
+            }
+            //don't pull past the stop, as the source may be unbounded
+            if(seq->bounded && iter->pos >= seq->stop)
+                return false;
+            iter->pos++;
+            return lv_seq_next(iter->src, elem);
+        case SEQ_ZIP: {
+            TextBufferObj a, b;
+            if(!lv_seq_next(iter->src, &a))
+                return false;
+            if(!lv_seq_next(iter->other, &b)) {
+                lv_expr_cleanup(&a, 1);
+                return false;
+            }
+            //the pair takes over the references to the elements
+            LvVect* pair = lv_alloc(sizeof(LvVect) + 2 * sizeof(TextBufferObj));
+            pair->refCount = 1;
+            pair->hash = 0;
+            pair->len = 2;
+            pair->tree = NULL;
+            pair->packed = OPT_UNDEFINED;
+            pair->data[0] = a;
+            pair->data[1] = b;
+            elem->type = OPT_VECT;
+            elem->vect = pair;
+            return true;
+        }
+        case SEQ_CONCAT:
+            if(!iter->started) {
+                if(lv_seq_next(iter->src, elem))
+                    return true;
+                iter->started = true;
+            }
+            return lv_seq_next(iter->other, elem);
+    }
+    assert(false);
+    return false;
+}
+
+bool lv_seq_next(SeqIter* iter, TextBufferObj* elem) {
+
+    //sources such as iterate must not be pulled again once they end
+    if(iter->done)
+        return false;
+    if(!next(iter, elem)) {
+        iter->done = true;
+        return false;
+    }
+    return true;
+}
+
+void lv_seq_endIter(SeqIter* iter) {
+
+    if(iter->src)
+        lv_seq_endIter(iter->src);
+    if(iter->other)
+        lv_seq_endIter(iter->other);
+    lv_expr_cleanup(&iter->state, 1);
+    if(--iter->seq->refCount == 0)
+        lv_seq_free(iter->seq);
+    lv_free(iter);
+}
+
+void lv_seq_free(LvSeq* seq) {
+
+    //free iteratively so long chains of stages do not overflow the C stack
+    while(seq) {
+        assert(seq->refCount == 0);
+        LvSeq* src = seq->src;
+        lv_expr_cleanup(&seq->value, 1);
+        lv_expr_cleanup(&seq->func, 1);
+        if(seq->other && --seq->other->refCount == 0)
+            lv_seq_free(seq->other);
+        lv_free(seq);
+        if(src && --src->refCount != 0)
+            break;
+        seq = src;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef SEQ_H
+#define SEQ_H
+#include "textbuffer.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Lavender sequences are lazy. A sequence is a source of elements with
+ * a chain of stages applied to it, and no element is computed until the
+ * sequence is iterated. Iterating pulls each element through all the
+ * stages in turn, so a pipeline builds no intermediate collections and
+ * unbounded sources can be iterated in constant memory. Sequences are
+ * immutable, and a stage shares the sequence it applies to. Sequences
+ * returned by these functions are new values with a refCount of 0,
+ * except where noted.
+ */
+
+typedef enum SeqKind {
+    //sources
+    SEQ_VECT,       //elements of a vect
+    SEQ_LIST,       //elements of a list
+    SEQ_STRING,     //characters of a string
+    SEQ_RANGE,      //ints of a range, or from start if unbounded
+    SEQ_ITERATE,    //a seed and the results of applying func repeatedly
+    SEQ_COROUTINE,  //values yielded by a coroutine
+    //stages
+    SEQ_MAP,
+    SEQ_FILTER,
+    SEQ_WHILE,      //elements up to the first one failing the predicate
+    SEQ_FLATMAP,
+    SEQ_SLICE,      //elements from start up to stop
+    SEQ_ZIP,        //pairs of the elements of src and other
+    SEQ_CONCAT,     //elements of src followed by the elements of other
+} SeqKind;
+
+struct LvSeq {
+    size_t refCount;
+    SeqKind kind;
+    LvSeq* src;             //the sequence a stage applies to, NULL for sources
+    LvSeq* other;           //the second sequence of zip and concat
+    TextBufferObj value;    //source collection or range, seed, or stage function
+    TextBufferObj func;     //function of iterate
+    uint64_t start, stop;   //start of an unbounded range, bounds of slice
+    bool bounded;           //whether there is a range or stop
+};
+
+/**
+ * Returns a sequence of the elements of a vect, list, or range, of
+ * the characters of a string, or of the values a coroutine yields from
+ * where it is suspended. Returns a sequence itself, or NULL for other
+ * values.
+ */
+LvSeq* lv_seq_of(TextBufferObj* obj);
+
+/** Returns the unbounded sequence of ints counting up from start. */
+LvSeq* lv_seq_from(uint64_t start);
+
+/** Returns the sequence seed, func(seed), func(func(seed)), ... */
+LvSeq* lv_seq_iterate(TextBufferObj* seed, TextBufferObj* func);
+
+/**
+ * Returns the sequence with a map, filter, while, or flatmap stage
+ * applying func. Flatmap iterates each result that is a collection,
+ * and yields other results as single elements.
+ */
+LvSeq* lv_seq_apply(SeqKind kind, LvSeq* src, TextBufferObj* func);
+
+/** Returns the elements of src from start up to stop, if bounded. */
+LvSeq* lv_seq_slice(LvSeq* src, uint64_t start, uint64_t stop, bool bounded);
+
+/** Returns the zip or concatenation of two sequences. */
+LvSeq* lv_seq_join(SeqKind kind, LvSeq* src, LvSeq* other);
+
+/** The state of one iteration over a sequence. */
+typedef struct SeqIter SeqIter;
+
+/** Starts iterating over the sequence. */
+SeqIter* lv_seq_iter(LvSeq* seq);
+
+/**
+ * Stores the next element in elem and returns true, or returns false
+ * if there are no more elements. The element is owned by the caller.
+ */
+bool lv_seq_next(SeqIter* iter, TextBufferObj* elem);
+
+/** Ends the iteration and frees its state. */
+void lv_seq_endIter(SeqIter* iter);
+
+/** Frees a sequence whose refCount has reached 0. */
+void lv_seq_free(LvSeq* seq);
+
+#endif
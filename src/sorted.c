@@ -0,0 +1,589 @@
+#include "sorted.h"
+#include "textbuffer.h"
+#include "builtin.h"
+#include "expression.h"
+#include "lavender.h"
+#include <string.h>
+#include <assert.h>
+
+#define ORDER 16    //maximum children of a node
+#define MAX_KEYS (ORDER - 1)
+#define MIN_KEYS (ORDER / 2 - 1)
+
+/**
+ * A node of the B-tree. Every node but the root has between MIN_KEYS
+ * and MAX_KEYS keys, and every leaf is at the same depth. Nodes are
+ * shared between sorted maps and keep a refCount of the sorted maps
+ * and nodes referring to them.
+ */
+typedef struct SortedNode SortedNode;
+struct SortedNode {
+    size_t refCount;
+    size_t size;    //number of keys in the subtree
+    int numKeys;
+    bool leaf;
+    //one extra slot so a node may overflow before it is split
+    TextBufferObj keys[MAX_KEYS + 1];
+    TextBufferObj values[MAX_KEYS + 1];
+    SortedNode* children[ORDER + 1];
+};
+
+static void incRefCount(TextBufferObj* obj) {
+
+    if(obj->type & LV_DYNAMIC)
+        ++*obj->refCount;
+}
+
+static SortedNode* allocNode(bool leaf) {
+
+    SortedNode* node = lv_alloc(sizeof(SortedNode));
+    node->refCount = 0;
+    node->size = 0;
+    node->numKeys = 0;
+    node->leaf = leaf;
+    return node;
+}
+
+static SortedNode* copyNode(SortedNode* node) {
+
+    SortedNode* res = lv_alloc(sizeof(SortedNode));
+    memcpy(res, node, sizeof(SortedNode));
+    res->refCount = 0;
+    for(int i = 0; i < res->numKeys; i++) {
+        incRefCount(&res->keys[i]);
+        incRefCount(&res->values[i]);
+    }
+    if(!res->leaf) {
+        for(int i = 0; i <= res->numKeys; i++)
+            res->children[i]->refCount++;
+    }
+    return res;
+}
+
+static void releaseNode(SortedNode* node) {
+
+    assert(node->refCount);
+    if(--node->refCount == 0) {
+        lv_expr_cleanup(node->keys, node->numKeys);
+        lv_expr_cleanup(node->values, node->numKeys);
+        if(!node->leaf) {
+            for(int i = 0; i <= node->numKeys; i++)
+                releaseNode(node->children[i]);
+        }
+        lv_free(node);
+    }
+}
+
+/** Replaces the i'th child of a node that is not shared. */
+static void setChild(SortedNode* node, int i, SortedNode* child) {
+
+    child->refCount++;
+    releaseNode(node->children[i]);
+    node->children[i] = child;
+}
+
+static size_t childSize(SortedNode* node, int i) {
+
+    return node->leaf ? 0 : node->children[i]->size;
+}
+
+static size_t computeSize(SortedNode* node) {
+
+    size_t size = node->numKeys;
+    for(int i = 0; i <= node->numKeys; i++)
+        size += childSize(node, i);
+    return size;
+}
+
+/**
+ * Returns the index of the first key of the node not less than the
+ * given key, and sets found to whether that key is equivalent.
+ */
+static int search(SortedNode* node, TextBufferObj* key, bool* found) {
+
+    int lo = 0;
+    int hi = node->numKeys;
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(lv_blt_compare(&node->keys[mid], key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *found = lo < node->numKeys && lv_blt_compare(&node->keys[lo], key) == 0;
+    return lo;
+}
+
+/**
+ * Inserts the key and value at i in a node that is not shared, with the
+ * given child after them. The node takes the references passed in.
+ */
+static void insertAt(SortedNode* node, int i, TextBufferObj key, TextBufferObj value, SortedNode* right) {
+
+    int after = node->numKeys - i;
+    memmove(&node->keys[i + 1], &node->keys[i], after * sizeof(TextBufferObj));
+    memmove(&node->values[i + 1], &node->values[i], after * sizeof(TextBufferObj));
+    if(!node->leaf) {
+        memmove(&node->children[i + 2], &node->children[i + 1], after * sizeof(SortedNode*));
+        node->children[i + 1] = right;
+    }
+    node->keys[i] = key;
+    node->values[i] = value;
+    node->numKeys++;
+}
+
+/**
+ * Removes the key and value at i from a node that is not shared, along
+ * with the child after them. The references are passed to the caller.
+ */
+static void removeAt(SortedNode* node, int i, TextBufferObj* key, TextBufferObj* value, SortedNode** right) {
+
+    int after = node->numKeys - i - 1;
+    *key = node->keys[i];
+    *value = node->values[i];
+    memmove(&node->keys[i], &node->keys[i + 1], after * sizeof(TextBufferObj));
+    memmove(&node->values[i], &node->values[i + 1], after * sizeof(TextBufferObj));
+    if(!node->leaf) {
+        *right = node->children[i + 1];
+        memmove(&node->children[i + 1], &node->children[i + 2], after * sizeof(SortedNode*));
+    } else {
+        *right = NULL;
+    }
+    node->numKeys--;
+}
+
+/** Like insertAt(node, 0, ...), but with the given child before the key. */
+static void insertFront(SortedNode* node, TextBufferObj key, TextBufferObj value, SortedNode* left) {
+
+    memmove(&node->keys[1], &node->keys[0], node->numKeys * sizeof(TextBufferObj));
+    memmove(&node->values[1], &node->values[0], node->numKeys * sizeof(TextBufferObj));
+    if(!node->leaf) {
+        memmove(&node->children[1], &node->children[0], (node->numKeys + 1) * sizeof(SortedNode*));
+        node->children[0] = left;
+    }
+    node->keys[0] = key;
+    node->values[0] = value;
+    node->numKeys++;
+}
+
+/** Like removeAt(node, 0, ...), but removes the child before the key. */
+static void removeFront(SortedNode* node, TextBufferObj* key, TextBufferObj* value, SortedNode** left) {
+
+    *key = node->keys[0];
+    *value = node->values[0];
+    memmove(&node->keys[0], &node->keys[1], (node->numKeys - 1) * sizeof(TextBufferObj));
+    memmove(&node->values[0], &node->values[1], (node->numKeys - 1) * sizeof(TextBufferObj));
+    if(!node->leaf) {
+        *left = node->children[0];
+        memmove(&node->children[0], &node->children[1], node->numKeys * sizeof(SortedNode*));
+    } else {
+        *left = NULL;
+    }
+    node->numKeys--;
+}
+
+typedef struct Split {
+    TextBufferObj key;      //owned reference
+    TextBufferObj value;    //owned reference
+    SortedNode* right;
+} Split;
+
+/**
+ * Splits an overflowing node that is not shared. The node keeps the
+ * lower half of its keys, and the median key and upper half are
+ * passed out through split.
+ */
+static void splitNode(SortedNode* node, Split* split) {
+
+    int mid = node->numKeys / 2;
+    SortedNode* right = allocNode(node->leaf);
+    right->numKeys = node->numKeys - mid - 1;
+    memcpy(right->keys, &node->keys[mid + 1], right->numKeys * sizeof(TextBufferObj));
+    memcpy(right->values, &node->values[mid + 1], right->numKeys * sizeof(TextBufferObj));
+    if(!node->leaf)
+        memcpy(right->children, &node->children[mid + 1], (right->numKeys + 1) * sizeof(SortedNode*));
+    split->key = node->keys[mid];
+    split->value = node->values[mid];
+    split->right = right;
+    node->numKeys = mid;
+    node->size = computeSize(node);
+    right->size = computeSize(right);
+}
+
+/**
+ * Returns a copy of the node with the key associated with the value.
+ * Sets added to whether the key is new. If the copy overflows, it is
+ * split and split->right is set, otherwise split->right is NULL.
+ */
+static SortedNode* assocNode(SortedNode* node, TextBufferObj* key, TextBufferObj* value,
+    bool* added, Split* split) {
+
+    bool found;
+    int i = search(node, key, &found);
+    SortedNode* res = copyNode(node);
+    split->right = NULL;
+    if(found) {
+        lv_expr_cleanup(&res->keys[i], 1);
+        lv_expr_cleanup(&res->values[i], 1);
+        res->keys[i] = *key;
+        res->values[i] = *value;
+        incRefCount(key);
+        incRefCount(value);
+        *added = false;
+        return res;
+    }
+    if(res->leaf) {
+        incRefCount(key);
+        incRefCount(value);
+        insertAt(res, i, *key, *value, NULL);
+        *added = true;
+    } else {
+        Split childSplit;
+        setChild(res, i, assocNode(res->children[i], key, value, added, &childSplit));
+        if(childSplit.right) {
+            childSplit.right->refCount++;
+            insertAt(res, i, childSplit.key, childSplit.value, childSplit.right);
+        }
+    }
+    res->size += *added;
+    if(res->numKeys > MAX_KEYS)
+        splitNode(res, split);
+    return res;
+}
+
+/**
+ * Restores the minimum number of keys of the i'th child of a node
+ * that is not shared, by moving a key from a sibling or by merging
+ * the child with a sibling.
+ */
+static void fixUnderflow(SortedNode* node, int i) {
+
+    if(node->children[i]->numKeys >= MIN_KEYS)
+        return;
+    TextBufferObj key, value;
+    SortedNode* moved;
+    if(i > 0 && node->children[i - 1]->numKeys > MIN_KEYS) {
+        //rotate the greatest key of the left sibling through the parent
+        SortedNode* left = copyNode(node->children[i - 1]);
+        SortedNode* right = copyNode(node->children[i]);
+        removeAt(left, left->numKeys - 1, &key, &value, &moved);
+        insertFront(right, node->keys[i - 1], node->values[i - 1], moved);
+        node->keys[i - 1] = key;
+        node->values[i - 1] = value;
+        size_t movedSize = 1 + (moved ? moved->size : 0);
+        left->size -= movedSize;
+        right->size += movedSize;
+        setChild(node, i - 1, left);
+        setChild(node, i, right);
+    } else if(i < node->numKeys && node->children[i + 1]->numKeys > MIN_KEYS) {
+        //rotate the least key of the right sibling through the parent
+        SortedNode* left = copyNode(node->children[i]);
+        SortedNode* right = copyNode(node->children[i + 1]);
+        removeFront(right, &key, &value, &moved);
+        insertAt(left, left->numKeys, node->keys[i], node->values[i], moved);
+        node->keys[i] = key;
+        node->values[i] = value;
+        size_t movedSize = 1 + (moved ? moved->size : 0);
+        left->size += movedSize;
+        right->size -= movedSize;
+        setChild(node, i, left);
+        setChild(node, i + 1, right);
+    } else {
+        //merge the child, a sibling, and the key between them
+        int j = (i > 0) ? i - 1 : i;
+        SortedNode* left = copyNode(node->children[j]);
+        SortedNode* right;
+        removeAt(node, j, &key, &value, &right);
+        int base = left->numKeys + 1;
+        left->keys[left->numKeys] = key;
+        left->values[left->numKeys] = value;
+        for(int k = 0; k < right->numKeys; k++) {
+            left->keys[base + k] = right->keys[k];
+            left->values[base + k] = right->values[k];
+            incRefCount(&left->keys[base + k]);
+            incRefCount(&left->values[base + k]);
+        }
+        if(!left->leaf) {
+            for(int k = 0; k <= right->numKeys; k++) {
+                left->children[base + k] = right->children[k];
+                right->children[k]->refCount++;
+            }
+        }
+        left->numKeys = base + right->numKeys;
+        left->size += 1 + right->size;
+        releaseNode(right);
+        setChild(node, j, left);
+    }
+}
+
+/**
+ * Returns a copy of the node without its greatest key, which is
+ * passed out through key and value. The copy may underflow.
+ */
+static SortedNode* dissocMax(SortedNode* node, TextBufferObj* key, TextBufferObj* value) {
+
+    SortedNode* res;
+    if(node->leaf) {
+        SortedNode* none;
+        res = copyNode(node);
+        removeAt(res, res->numKeys - 1, key, value, &none);
+    } else {
+        int last = node->numKeys;
+        SortedNode* child = dissocMax(node->children[last], key, value);
+        res = copyNode(node);
+        setChild(res, last, child);
+        fixUnderflow(res, last);
+    }
+    res->size--;
+    return res;
+}
+
+/**
+ * Returns a copy of the node without the key, or the node itself
+ * if the key is not present. The copy may underflow.
+ */
+static SortedNode* dissocNode(SortedNode* node, TextBufferObj* key) {
+
+    bool found;
+    int i = search(node, key, &found);
+    SortedNode* res;
+    if(node->leaf) {
+        if(!found)
+            return node;
+        TextBufferObj k, v;
+        SortedNode* none;
+        res = copyNode(node);
+        removeAt(res, i, &k, &v, &none);
+        lv_expr_cleanup(&k, 1);
+        lv_expr_cleanup(&v, 1);
+    } else if(found) {
+        //replace the key with its predecessor
+        TextBufferObj k, v;
+        SortedNode* child = dissocMax(node->children[i], &k, &v);
+        res = copyNode(node);
+        lv_expr_cleanup(&res->keys[i], 1);
+        lv_expr_cleanup(&res->values[i], 1);
+        res->keys[i] = k;
+        res->values[i] = v;
+        setChild(res, i, child);
+        fixUnderflow(res, i);
+    } else {
+        SortedNode* child = dissocNode(node->children[i], key);
+        if(child == node->children[i])
+            return node;
+        res = copyNode(node);
+        setChild(res, i, child);
+        fixUnderflow(res, i);
+    }
+    res->size--;
+    return res;
+}
+
+static LvSorted* newSorted(bool set, SortedNode* root, size_t len) {
+
+    LvSorted* sorted = lv_alloc(sizeof(LvSorted));
+    sorted->refCount = 0;
+    sorted->hash = 0;
+    sorted->len = len;
+    sorted->set = set;
+    sorted->root = root;
+    if(root)
+        root->refCount++;
+    return sorted;
+}
+
+LvSorted* lv_sorted_new(bool set) {
+
+    return newSorted(set, NULL, 0);
+}
+
+TextBufferObj* lv_sorted_get(LvSorted* sorted, TextBufferObj* key) {
+
+    for(SortedNode* node = sorted->root; node; ) {
+        bool found;
+        int i = search(node, key, &found);
+        if(found)
+            return &node->values[i];
+        node = node->leaf ? NULL : node->children[i];
+    }
+    return NULL;
+}
+
+LvSorted* lv_sorted_assoc(LvSorted* sorted, TextBufferObj* key, TextBufferObj* value) {
+
+    if(!sorted->root) {
+        SortedNode* root = allocNode(true);
+        incRefCount(key);
+        incRefCount(value);
+        insertAt(root, 0, *key, *value, NULL);
+        root->size = 1;
+        return newSorted(sorted->set, root, 1);
+    }
+    bool added;
+    Split split;
+    SortedNode* root = assocNode(sorted->root, key, value, &added, &split);
+    if(split.right) {
+        //grow the tree by one level
+        SortedNode* top = allocNode(false);
+        top->children[0] = root;
+        root->refCount++;
+        split.right->refCount++;
+        insertAt(top, 0, split.key, split.value, split.right);
+        top->size = computeSize(top);
+        root = top;
+    }
+    return newSorted(sorted->set, root, sorted->len + added);
+}
+
+LvSorted* lv_sorted_dissoc(LvSorted* sorted, TextBufferObj* key) {
+
+    if(!sorted->root)
+        return sorted;
+    SortedNode* root = dissocNode(sorted->root, key);
+    if(root == sorted->root)
+        return sorted;
+    if(root->numKeys > 0)
+        return newSorted(sorted->set, root, sorted->len - 1);
+    //shrink the tree by one level
+    LvSorted* res = newSorted(sorted->set, root->leaf ? NULL : root->children[0], sorted->len - 1);
+    root->refCount++;
+    releaseNode(root);
+    return res;
+}
+
+TextBufferObj* lv_sorted_floor(LvSorted* sorted, TextBufferObj* key) {
+
+    TextBufferObj* res = NULL;
+    for(SortedNode* node = sorted->root; node; ) {
+        bool found;
+        int i = search(node, key, &found);
+        if(found)
+            return &node->keys[i];
+        if(i > 0)
+            res = &node->keys[i - 1];
+        node = node->leaf ? NULL : node->children[i];
+    }
+    return res;
+}
+
+TextBufferObj* lv_sorted_ceiling(LvSorted* sorted, TextBufferObj* key) {
+
+    TextBufferObj* res = NULL;
+    for(SortedNode* node = sorted->root; node; ) {
+        bool found;
+        int i = search(node, key, &found);
+        if(found)
+            return &node->keys[i];
+        if(i < node->numKeys)
+            res = &node->keys[i];
+        node = node->leaf ? NULL : node->children[i];
+    }
+    return res;
+}
+
+size_t lv_sorted_rank(LvSorted* sorted, TextBufferObj* key) {
+
+    size_t rank = 0;
+    for(SortedNode* node = sorted->root; node; ) {
+        bool found;
+        int i = search(node, key, &found);
+        rank += i;
+        for(int c = 0; c < i; c++)
+            rank += childSize(node, c);
+        if(found)
+            return rank + childSize(node, i);
+        node = node->leaf ? NULL : node->children[i];
+    }
+    return rank;
+}
+
+TextBufferObj* lv_sorted_at(LvSorted* sorted, size_t idx) {
+
+    if(idx >= sorted->len)
+        return NULL;
+    SortedNode* node = sorted->root;
+    for(;;) {
+        for(int c = 0; c <= node->numKeys; c++) {
+            size_t size = childSize(node, c);
+            if(idx < size) {
+                node = node->children[c];
+                break;
+            }
+            idx -= size;
+            assert(c < node->numKeys);
+            if(idx == 0)
+                return &node->keys[c];
+            idx--;
+        }
+    }
+}
+
+/** Returns false if the visit stopped early. */
+static bool visitRange(SortedNode* node, TextBufferObj* lo, TextBufferObj* hi,
+    SortedVisitor visit, void* data) {
+
+    bool found;
+    int start = lo ? search(node, lo, &found) : 0;
+    for(int i = start; i <= node->numKeys; i++) {
+        if(!node->leaf && !visitRange(node->children[i], lo, hi, visit, data))
+            return false;
+        if(i == node->numKeys)
+            break;
+        if(hi && lv_blt_compare(&node->keys[i], hi) >= 0)
+            return false;
+        if(!visit(&node->keys[i], &node->values[i], data))
+            return false;
+    }
+    return true;
+}
+
+void lv_sorted_forEach(LvSorted* sorted, TextBufferObj* lo, TextBufferObj* hi,
+    SortedVisitor visit, void* data) {
+
+    if(sorted->root)
+        visitRange(sorted->root, lo, hi, visit, data);
+}
+
+typedef struct EqualState {
+    LvSorted* other;
+    bool equal;
+} EqualState;
+
+static bool hasEntry(TextBufferObj* key, TextBufferObj* value, void* data) {
+
+    EqualState* state = data;
+    TextBufferObj* other = lv_sorted_get(state->other, key);
+    state->equal = other && lv_blt_equal(value, other);
+    return state->equal;
+}
+
+bool lv_sorted_equal(LvSorted* a, LvSorted* b) {
+
+    if(a->set != b->set || a->len != b->len)
+        return false;
+    EqualState state = { b, true };
+    lv_sorted_forEach(a, NULL, NULL, hasEntry, &state);
+    return state.equal;
+}
+
+static bool hashEntry(TextBufferObj* key, TextBufferObj* value, void* data) {
+
+    uint64_t* h = data;
+    *h = (*h * 31 + lv_blt_hash(key)) * 31 + lv_blt_hash(value);
+    return true;
+}
+
+uint64_t lv_sorted_hashEntries(LvSorted* sorted) {
+
+    uint64_t h = sorted->set;
+    lv_sorted_forEach(sorted, NULL, NULL, hashEntry, &h);
+    return h;
+}
+
+void lv_sorted_free(LvSorted* sorted) {
+
+    assert(sorted->refCount == 0);
+    if(sorted->root)
+        releaseNode(sorted->root);
+    lv_free(sorted);
+}
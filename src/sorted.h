@@ -0,0 +1,70 @@
+#ifndef SORTED_H
+#define SORTED_H
+#include "textbuffer_fwd.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Lavender sorted maps and sets are persistent B-trees ordered by
+ * sys:__lt__. Updates copy the nodes on the path to the changed key
+ * and share the rest with the original. A sorted set is a sorted map
+ * whose keys are mapped to themselves. Sorted maps returned by these
+ * functions are new values with a refCount of 0, except where noted.
+ */
+
+/** Returns a new empty sorted map, or sorted set if set is true. */
+LvSorted* lv_sorted_new(bool set);
+
+/**
+ * Returns the value associated with the given key, or NULL if
+ * the key is not present. The value is owned by the sorted map.
+ */
+TextBufferObj* lv_sorted_get(LvSorted* sorted, TextBufferObj* key);
+
+/** Returns a sorted map with the given key associated with the given value. */
+LvSorted* lv_sorted_assoc(LvSorted* sorted, TextBufferObj* key, TextBufferObj* value);
+
+/**
+ * Returns a sorted map without the given key. If the key is not
+ * present, returns the sorted map itself.
+ */
+LvSorted* lv_sorted_dissoc(LvSorted* sorted, TextBufferObj* key);
+
+/**
+ * Returns the greatest key not greater than the given key,
+ * or NULL if there is none.
+ */
+TextBufferObj* lv_sorted_floor(LvSorted* sorted, TextBufferObj* key);
+
+/**
+ * Returns the least key not less than the given key,
+ * or NULL if there is none.
+ */
+TextBufferObj* lv_sorted_ceiling(LvSorted* sorted, TextBufferObj* key);
+
+/** Returns the number of keys less than the given key. */
+size_t lv_sorted_rank(LvSorted* sorted, TextBufferObj* key);
+
+/** Returns the key with the given rank, or NULL if out of bounds. */
+TextBufferObj* lv_sorted_at(LvSorted* sorted, size_t idx);
+
+/**
+ * Calls the visitor with each key and value in ascending order, from
+ * the least key not less than lo to the greatest key less than hi.
+ * Either bound may be NULL. Stops early if the visitor returns false.
+ */
+typedef bool (*SortedVisitor)(TextBufferObj* key, TextBufferObj* value, void* data);
+void lv_sorted_forEach(LvSorted* sorted, TextBufferObj* lo, TextBufferObj* hi,
+    SortedVisitor visit, void* data);
+
+/** Returns whether the sorted maps have equal keys mapped to equal values. */
+bool lv_sorted_equal(LvSorted* a, LvSorted* b);
+
+/** Combines the hashes of the entries of the sorted map in order. */
+uint64_t lv_sorted_hashEntries(LvSorted* sorted);
+
+/** Frees a sorted map whose refCount has reached 0. */
+void lv_sorted_free(LvSorted* sorted);
+
+#endif
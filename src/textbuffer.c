@@ -3,6 +3,11 @@
 #include "expression.h"
 #include "operator.h"
 #include "builtin.h"
+#include "dynbuffer.h"
+#include "optimize.h"
+#include "map.h"
+#include "sorted.h"
+#include "vect.h"
 #include <string.h>
 #include <stdio.h>
 #include <inttypes.h>
@@ -40,6 +45,49 @@ static size_t length(int number) {
     return len;
 }
 
+typedef struct MapString {
+    LvString* res;
+    size_t len;
+    bool keysOnly;  //for sorted sets
+} MapString;
+
+static bool appendEntry(TextBufferObj* key, TextBufferObj* value, void* data) {
+
+    MapString* str = data;
+    LvString* k = lv_tb_getString(key);
+    str->len += k->len + 2;
+    str->res = lv_realloc(str->res, sizeof(LvString) + str->len + 1);
+    strcat(str->res->value, k->value);
+    if(k->refCount == 0)
+        lv_free(k);
+    if(!str->keysOnly) {
+        LvString* v = lv_tb_getString(value);
+        str->len += v->len + 4;
+        str->res = lv_realloc(str->res, sizeof(LvString) + str->len + 1);
+        strcat(str->res->value, " -> ");
+        strcat(str->res->value, v->value);
+        if(v->refCount == 0)
+            lv_free(v);
+    }
+    strcat(str->res->value, ", ");
+    return true;
+}
+
+/** Finishes a string started with "name{ " and appended entries. */
+static LvString* finishMapString(MapString* str, size_t numEntries) {
+
+    if(numEntries == 0) {
+        str->len++;
+        str->res = lv_realloc(str->res, sizeof(LvString) + str->len + 1);
+        strcat(str->res->value, "}");
+    } else {
+        str->res->value[str->len - 2] = ' ';
+        str->res->value[str->len - 1] = '}';
+    }
+    str->res->len = str->len;
+    return str->res;
+}
+
 LvString* lv_tb_getString(TextBufferObj* obj) {
 
     LvString* res;
@@ -48,6 +96,7 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             static char str[] = "<undefined>";
             res = lv_alloc(sizeof(LvString) + sizeof(str));
             res->refCount = 0;
+            res->hash = 0;
             res->len = sizeof(str) - 1;
             strcpy(res->value, str);
             return res;
@@ -66,6 +115,7 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             res = lv_alloc(sizeof(LvString) + len + 1);
             snprintf(res->value, len + 1, "%g", obj->number);
             res->refCount = 0;
+            res->hash = 0;
             res->len = len;
             return res;
         }
@@ -78,6 +128,7 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             size_t len = snprintf(NULL, 0, "%"PRIu64, value);
             res = lv_alloc(sizeof(LvString) + negative + len + 1);
             res->refCount = 0;
+            res->hash = 0;
             res->len = negative + len;
             if(negative) {
                 res->value[0] = '-';
@@ -90,19 +141,21 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             size_t len = strlen(obj->func->name);
             res = lv_alloc(sizeof(LvString) + len + 1);
             res->refCount = 0;
+            res->hash = 0;
             res->len = len;
             strcpy(res->value, obj->func->name);
             return res;
         }
         case OPT_CAPTURE: {
             //func-name[cap1, cap2, ..., capn]
-            size_t len = strlen(obj->capfunc->name) + 1;
+            size_t len = strlen(obj->capture->func->name) + 1;
             res = lv_alloc(sizeof(LvString) + len + 1);
             res->refCount = 0;
-            strcpy(res->value, obj->capfunc->name);
+            res->hash = 0;
+            strcpy(res->value, obj->capture->func->name);
             res->value[len - 1] = '[';
             res->value[len] = '\0';
-            for(int i = 0; i < obj->capfunc->captureCount; i++) {
+            for(int i = 0; i < obj->capture->func->captureCount; i++) {
                 LvString* tmp = lv_tb_getString(&obj->capture->value[i]);
                 len += tmp->len + 1;
                 res = lv_realloc(res, sizeof(LvString) + len + 1);
@@ -122,6 +175,7 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
                 static char str[] = "{ }";
                 res = lv_alloc(sizeof(LvString) + sizeof(str));
                 res->refCount = 0;
+                res->hash = 0;
                 res->len = sizeof(str) - 1;
                 memcpy(res->value, str, sizeof(str));
                 return res;
@@ -130,12 +184,14 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             size_t len = 2;
             res = lv_alloc(sizeof(LvString) + len + 1);
             res->refCount = 0;
+            res->hash = 0;
             res->value[0] = '{';
             res->value[1] = ' ';
             res->value[2] = '\0';
             //concatenate values
             for(size_t i = 0; i < obj->vect->len; i++) {
-                LvString* tmp = lv_tb_getString(&obj->vect->data[i]);
+                TextBufferObj elem = lv_vect_get(obj->vect, i);
+                LvString* tmp = lv_tb_getString(&elem);
                 len += tmp->len + 2;
                 res = lv_realloc(res, sizeof(LvString) + len + 1);
                 strcat(res->value, tmp->value);
@@ -150,6 +206,78 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             res->len = len;
             return res;
         }
+        case OPT_MAP: {
+            //map{ key1 -> val1, ..., keyn -> valn }
+            MapString str = { lv_alloc(sizeof(LvString) + 6), 5, false };
+            str.res->refCount = 0;
+            str.res->hash = 0;
+            strcpy(str.res->value, "map{ ");
+            lv_map_forEach(obj->map, appendEntry, &str);
+            return finishMapString(&str, obj->map->len);
+        }
+        case OPT_SORTED: {
+            //sorted{ key1 -> val1, ..., keyn -> valn } or sorted{ key1, ..., keyn }
+            MapString str = { lv_alloc(sizeof(LvString) + 9), 8, obj->sorted->set };
+            str.res->refCount = 0;
+            str.res->hash = 0;
+            strcpy(str.res->value, "sorted{ ");
+            lv_sorted_forEach(obj->sorted, NULL, NULL, appendEntry, &str);
+            return finishMapString(&str, obj->sorted->len);
+        }
+        case OPT_LIST: {
+            //[ val1 val2 ... valn ]
+            size_t len = 2;
+            res = lv_alloc(sizeof(LvString) + len + 1);
+            res->refCount = 0;
+            res->hash = 0;
+            res->value[0] = '[';
+            res->value[1] = ' ';
+            for(LvList* cell = obj->list->len ? obj->list : NULL; cell; cell = cell->tail) {
+                LvString* tmp = lv_tb_getString(&cell->head);
+                res = lv_realloc(res, sizeof(LvString) + len + tmp->len + 2);
+                memcpy(res->value + len, tmp->value, tmp->len);
+                len += tmp->len;
+                res->value[len++] = ' ';
+                if(tmp->refCount == 0)
+                    lv_free(tmp);
+            }
+            res = lv_realloc(res, sizeof(LvString) + len + 2);
+            res->value[len++] = ']';
+            res->value[len] = '\0';
+            res->len = len;
+            return res;
+        }
+        case OPT_SEQ:
+        case OPT_COROUTINE: {
+            //sequences and coroutines are not run to print them
+            char* str = obj->type == OPT_SEQ ? "seq" : "coroutine";
+            size_t len = strlen(str);
+            res = lv_alloc(sizeof(LvString) + len + 1);
+            res->refCount = 0;
+            res->hash = 0;
+            res->len = len;
+            strcpy(res->value, str);
+            return res;
+        }
+        case OPT_RANGE: {
+            //[start..stop) or [start..stop by step)
+            LvRange* range = obj->range;
+            char buf[96];
+            int len;
+            if(range->step == 1) {
+                len = snprintf(buf, sizeof(buf), "[%"PRId64"..%"PRId64")",
+                    (int64_t)range->start, (int64_t)range->stop);
+            } else {
+                len = snprintf(buf, sizeof(buf), "[%"PRId64"..%"PRId64" by %"PRId64")",
+                    (int64_t)range->start, (int64_t)range->stop, (int64_t)range->step);
+            }
+            res = lv_alloc(sizeof(LvString) + len + 1);
+            res->refCount = 0;
+            res->hash = 0;
+            res->len = len;
+            memcpy(res->value, buf, len + 1);
+            return res;
+        }
         //not called outside of debug mode
         case OPT_PARAM: {
             static char str[] = "param ";
@@ -157,6 +285,19 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             len += sizeof(str) - 1;
             res = lv_alloc(sizeof(LvString) + len + 1);
             res->refCount = 0;
+            res->hash = 0;
+            res->len = len;
+            strcpy(res->value, str);
+            sprintf(res->value + sizeof(str) - 1, "%d", obj->param);
+            return res;
+        }
+        case OPT_FORCE: {
+            static char str[] = "force ";
+            size_t len = length(obj->param);
+            len += sizeof(str) - 1;
+            res = lv_alloc(sizeof(LvString) + len + 1);
+            res->refCount = 0;
+            res->hash = 0;
             res->len = len;
             strcpy(res->value, str);
             sprintf(res->value + sizeof(str) - 1, "%d", obj->param);
@@ -168,6 +309,7 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             len += sizeof(str) - 1;
             res = lv_alloc(sizeof(LvString) + len + 1);
             res->refCount = 0;
+            res->hash = 0;
             res->len = len;
             strcpy(res->value, str);
             sprintf(res->value + sizeof(str) - 1, "%d", obj->param);
@@ -181,6 +323,7 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             len += LEN - 1;
             res = lv_alloc(sizeof(LvString) + len + LEN);
             res->refCount = 0;
+            res->hash = 0;
             res->len = len;
             sprintf(res->value, "%d", obj->callArity);
             strcat(res->value, obj->type == OPT_MAKE_VECT ? " VECT"
@@ -192,6 +335,7 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             static char str[] = "CAP";
             res = lv_alloc(sizeof(LvString) + sizeof(str));
             res->refCount = 0;
+            res->hash = 0;
             res->len = sizeof(str) - 1;
             strcpy(res->value, str);
             return res;
@@ -200,6 +344,7 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             static char str[] = "return";
             res = lv_alloc(sizeof(LvString) + sizeof(str));
             res->refCount = 0;
+            res->hash = 0;
             res->len = sizeof(str) - 1;
             strcpy(res->value, str);
             return res;
@@ -209,15 +354,70 @@ LvString* lv_tb_getString(TextBufferObj* obj) {
             size_t len = length(obj->branchAddr) + sizeof(str) - 1;
             res = lv_alloc(sizeof(LvString) + len + sizeof(str));
             res->refCount = 0;
+            res->hash = 0;
             res->len = len;
             strcpy(res->value, str);
             sprintf(res->value + sizeof(str) - 1, "%d", obj->branchAddr);
             return res;
         }
+        case OPT_REG_CALL: {
+            static char str[] = "reg param ";
+            size_t len = length(obj->regParam) + sizeof(str) - 1;
+            res = lv_alloc(sizeof(LvString) + len + 1);
+            res->refCount = 0;
+            res->hash = 0;
+            res->len = len;
+            strcpy(res->value, str);
+            sprintf(res->value + sizeof(str) - 1, "%d", obj->regParam);
+            return res;
+        }
+        case OPT_JUMP: {
+            static char str[] = "jump ";
+            size_t len = length(obj->branchAddr) + sizeof(str) - 1;
+            res = lv_alloc(sizeof(LvString) + len + 1);
+            res->refCount = 0;
+            res->hash = 0;
+            res->len = len;
+            strcpy(res->value, str);
+            sprintf(res->value + sizeof(str) - 1, "%d", obj->branchAddr);
+            return res;
+        }
+        case OPT_DISPATCH: {
+            static char str[] = "dispatch ";
+            size_t len = length(obj->table->param) + sizeof(str) - 1;
+            res = lv_alloc(sizeof(LvString) + len + 1);
+            res->refCount = 0;
+            res->hash = 0;
+            res->len = len;
+            strcpy(res->value, str);
+            sprintf(res->value + sizeof(str) - 1, "%d", obj->table->param);
+            return res;
+        }
+        case OPT_MAKE_THUNK: {
+            static char str[] = "thunk ";
+            size_t len = length(obj->branchAddr) + sizeof(str) - 1;
+            res = lv_alloc(sizeof(LvString) + len + 1);
+            res->refCount = 0;
+            res->hash = 0;
+            res->len = len;
+            strcpy(res->value, str);
+            sprintf(res->value + sizeof(str) - 1, "%d", obj->branchAddr);
+            return res;
+        }
+        case OPT_END_THUNK: {
+            static char str[] = "end thunk";
+            res = lv_alloc(sizeof(LvString) + sizeof(str));
+            res->refCount = 0;
+            res->hash = 0;
+            res->len = sizeof(str) - 1;
+            strcpy(res->value, str);
+            return res;
+        }
         default: {
             static char str[] = "<internal operator>";
             res = lv_alloc(sizeof(LvString) + sizeof(str));
             res->refCount = 0;
+            res->hash = 0;
             res->len = sizeof(str) - 1;
             strcpy(res->value, str);
             return res;
@@ -233,6 +433,8 @@ static void rollback(Operator* decl, size_t top) {
     for(size_t i = top; i < textBufferTop; i++) {
         if(TEXT_BUFFER[i].type == OPT_STRING)
             lv_free(TEXT_BUFFER[i].str);
+        else if(TEXT_BUFFER[i].type == OPT_DISPATCH)
+            lv_free(TEXT_BUFFER[i].table);
     }
     textBufferTop = top;
 }
@@ -259,6 +461,476 @@ Token* lv_tb_defineFunction(Token* head, Operator* scope, Operator** res) {
 
 static bool parseFunctionLocals(Operator* decl);
 
+static size_t hashFunc(Operator* func) {
+
+    //allocations are aligned, so the low bits are always zero
+    return (uintptr_t)func >> 4;
+}
+
+/**
+ * Returns whether the given condition has the form `param = \func`
+ * or `sys:__eq__(param, \func)`, and sets the out params if so.
+ */
+static bool isLiteralGuard(TextBufferObj* cond, size_t len, int* param, bool* checkObjects) {
+
+    if(len != 3
+        || cond[0].type != OPT_PARAM
+        || cond[1].type != OPT_FUNCTION_VAL
+        || cond[2].type != OPT_FUNCTION)
+        return false;
+    char* name = cond[2].func->name;
+    if(strcmp(name, "global:=") == 0 && cond[2].func->fixing != FIX_PRE)
+        *checkObjects = true;
+    else if(strcmp(name, "sys:__eq__") == 0)
+        *checkObjects = false;
+    else
+        return false;
+    *param = cond[0].param;
+    return true;
+}
+
+/**
+ * Returns whether the given function may be called with one argument.
+ */
+static bool acceptsOneArg(Operator* func) {
+
+    int formal = func->arity - func->captureCount;
+    return func->varargs ? (formal <= 2) : (formal == 1);
+}
+
+/**
+ * Returns whether the first piece of the given function is the
+ * object protocol guard `=> __yes__ ; param = __object__`, in which
+ * case every value of the function is object-like.
+ */
+static bool isObjectGuard(Operator* decl, TextBufferObj* cond, size_t clen,
+    TextBufferObj* body, size_t blen) {
+
+    if(decl->varargs || (decl->arity - decl->captureCount) != 1)
+        return false;
+    if(clen != 3
+        || cond[0].type != OPT_PARAM
+        || cond[0].param != 0
+        || cond[1].type != OPT_FUNCTION
+        || strcmp(cond[1].func->name, "global:__object__") != 0
+        || cond[2].type != OPT_FUNCTION)
+        return false;
+    char* name = cond[2].func->name;
+    if(!(strcmp(name, "global:=") == 0 && cond[2].func->fixing != FIX_PRE)
+        && strcmp(name, "sys:__eq__") != 0)
+        return false;
+    return blen == 1
+        && body[0].type == OPT_FUNCTION
+        && strcmp(body[0].func->name, "global:__yes__") == 0;
+}
+
+/**
+ * Builds the dispatch table for the OPT_DISPATCH instruction at idx,
+ * which is followed by count guards. The code after the guards
+ * starts at end.
+ */
+static void finishDispatch(size_t idx, int count, size_t end, int param, bool checkObjects) {
+
+    size_t size = 1;
+    while(size < 2 * (size_t)count)
+        size *= 2;
+    DispatchTable* table =
+        lv_alloc(sizeof(DispatchTable) + size * sizeof(struct DispatchEntry));
+    memset(table->entries, 0, size * sizeof(struct DispatchEntry));
+    table->param = param;
+    table->end = end - idx;
+    table->checkObjects = checkObjects;
+    table->checked = !checkObjects;
+    table->usable = !checkObjects;
+    table->size = size;
+    //each guard is 3 instructions, a branch, then the body
+    size_t cond = idx + 1;
+    for(int i = 0; i < count; i++) {
+        Operator* func = TEXT_BUFFER[cond + 1].func;
+        size_t branch = cond + 3;
+        assert(TEXT_BUFFER[branch].type == OPT_BEQZ);
+        size_t j = hashFunc(func) & (size - 1);
+        while(table->entries[j].func && table->entries[j].func != func)
+            j = (j + 1) & (size - 1);
+        //the first guard for a function wins
+        if(!table->entries[j].func) {
+            table->entries[j].func = func;
+            table->entries[j].target = branch + 1 - idx;
+        }
+        cond = branch + TEXT_BUFFER[branch].branchAddr;
+    }
+    TEXT_BUFFER[idx].table = table;
+}
+
+int lv_tb_dispatch(DispatchTable* table, Operator* func) {
+
+    size_t mask = table->size - 1;
+    for(size_t i = hashFunc(func) & mask; table->entries[i].func; i = (i + 1) & mask) {
+        if(table->entries[i].func == func)
+            return table->entries[i].target;
+    }
+    return table->end;
+}
+
+/**
+ * Returns the set of params the given code always evaluates
+ * with OPT_FORCE. Code for delayed arguments is skipped because
+ * it may never run.
+ */
+static uint64_t forcedParams(TextBufferObj* code, size_t len) {
+
+    uint64_t res = 0;
+    for(size_t i = 0; i < len; i++) {
+        if(code[i].type == OPT_MAKE_THUNK) {
+            i += code[i].branchAddr - 1;
+        } else if(code[i].type == OPT_FORCE && code[i].param < 64) {
+            res |= UINT64_C(1) << code[i].param;
+        }
+    }
+    return res;
+}
+
+/**
+ * A value on the stack while specializing code.
+ */
+typedef struct SpecValue {
+    Operator* func; //the constant function value, or NULL if unknown
+    size_t idx;     //the instruction that pushed the value
+} SpecValue;
+
+/**
+ * State for specializing the code of a function.
+ */
+typedef struct SpecState {
+    int param;          //param with a constant value, or -1
+    Operator* value;    //the value of the param
+    DynBuffer* out;     //code of the specialization, or NULL to patch in place
+    DynBuffer stack;    //values on the operand stack
+    DynBuffer thunks;   //start and stack height of each enclosing by name argument
+    int changed;        //number of calls specialized
+} SpecState;
+
+typedef struct SpecThunk {
+    size_t idx;     //the OPT_MAKE_THUNK instruction
+    size_t height;  //stack height before the argument
+} SpecThunk;
+
+static Operator* specialize(Operator* func, int param, Operator* value);
+
+/**
+ * Returns the instruction at idx in the code being specialized.
+ */
+static TextBufferObj* specCode(SpecState* state, size_t idx) {
+
+    return state->out ? lv_buf_get(state->out, idx) : &TEXT_BUFFER[idx];
+}
+
+/**
+ * Pops n values from the stack and returns a pointer to the first
+ * one. The pointer is valid until the next push.
+ */
+static SpecValue* popValues(SpecState* state, size_t n) {
+
+    size_t base = 0;
+    if(state->thunks.len > 0)
+        base = ((SpecThunk*)lv_buf_get(&state->thunks, state->thunks.len - 1))->height;
+    SpecValue unknown = { NULL, 0 };
+    while(state->stack.len < base + n)
+        lv_buf_push(&state->stack, &unknown);
+    state->stack.len -= n;
+    return lv_buf_get(&state->stack, state->stack.len);
+}
+
+/**
+ * Specializes func for each of the given args that is a constant function.
+ */
+static Operator* specializeArgs(SpecState* state, Operator* func, int first, SpecValue* args, int n) {
+
+    for(int i = 0; i < n; i++) {
+        if(!args[i].func)
+            continue;
+        Operator* spec = specialize(func, first + i, args[i].func);
+        if(spec != func && spec->type == FUN_FUNCTION)
+            state->changed++;
+        func = spec;
+    }
+    return func;
+}
+
+/**
+ * Specializes the straight line code starting at pc until the next
+ * branch or return, which is also copied. Calls of a constant function
+ * value become direct calls, and functions passed a constant function
+ * are specialized for it. Returns the index of the branch or return.
+ */
+static size_t specializeExpr(SpecState* state, size_t pc) {
+
+    state->stack.len = 0;
+    state->thunks.len = 0;
+    for(;; pc++) {
+        TextBufferObj obj = TEXT_BUFFER[pc];
+        SpecValue val = { NULL, 0 };
+        SpecValue* args;
+        switch(obj.type) {
+            case OPT_PARAM:
+            case OPT_FORCE:
+                if(obj.param == state->param)
+                    val.func = state->value;
+                break;
+            case OPT_REG_CALL:
+                //the operands and the call follow as usual
+                if(obj.regParam == state->param)
+                    val.func = state->value;
+                break;
+            case OPT_FUNCTION_VAL:
+                //functions with captures are always followed by OPT_FUNC_CAP
+                if(obj.func->captureCount == 0)
+                    val.func = obj.func;
+                break;
+            case OPT_FUNCTION:
+                args = popValues(state, obj.func->arity);
+                obj.func = specializeArgs(state, obj.func, 0, args, obj.func->arity);
+                break;
+            case OPT_FUNC_CAP: {
+                //the captured values, then the function value
+                Operator* func = TEXT_BUFFER[pc - 1].func;
+                args = popValues(state, func->captureCount + 1);
+                int formal = func->arity - func->captureCount;
+                func = specializeArgs(state, func, formal, args, func->captureCount);
+                specCode(state, args[func->captureCount].idx)->func = func;
+                break;
+            }
+            case OPT_FUNC_CALL2: {
+                args = popValues(state, obj.callArity);
+                Operator* func = args[0].func;
+                //the function value is a single instruction we can drop
+                if(state->out && func
+                    && !func->varargs
+                    && func->arity == obj.callArity - 1) {
+                    state->out->len--;
+                    memmove(specCode(state, args[0].idx), specCode(state, args[0].idx + 1),
+                        (state->out->len - args[0].idx) * sizeof(TextBufferObj));
+                    obj.type = OPT_FUNCTION;
+                    obj.func = func;
+                    state->changed++;
+                }
+                break;
+            }
+            case OPT_FUNC_CALL:
+                popValues(state, obj.callArity + 1);
+                break;
+            case OPT_MAKE_VECT:
+                popValues(state, obj.callArity);
+                break;
+            case OPT_PUT_PARAM:
+                popValues(state, 1);
+                break;
+            case OPT_MAKE_THUNK: {
+                SpecThunk thunk = { state->out ? state->out->len : pc, state->stack.len };
+                lv_buf_push(&state->thunks, &thunk);
+                break;
+            }
+            case OPT_END_THUNK: {
+                SpecThunk thunk;
+                lv_buf_pop(&state->thunks, &thunk);
+                state->stack.len = thunk.height;
+                if(state->out) {
+                    //dropped function values move the end of the argument
+                    size_t end = state->out->len;
+                    specCode(state, thunk.idx)->branchAddr = end - thunk.idx + 1;
+                    obj.branchAddr = end - thunk.idx;
+                }
+                break;
+            }
+            case OPT_DISPATCH:
+                //the guards following the table still work without it
+                if(state->out)
+                    continue;
+                break;
+            default:
+                if(obj.type & LV_DYNAMIC && state->out)
+                    (*obj.refCount)++;
+                break;
+        }
+        if(state->out) {
+            lv_buf_push(state->out, &obj);
+            val.idx = state->out->len - 1;
+        } else {
+            TEXT_BUFFER[pc] = obj;
+            val.idx = pc;
+        }
+        if(obj.type == OPT_BEQZ || obj.type == OPT_JUMP || obj.type == OPT_RETURN)
+            return pc;
+        if(obj.type != OPT_PUT_PARAM
+            && obj.type != OPT_MAKE_THUNK
+            && obj.type != OPT_DISPATCH)
+            lv_buf_push(&state->stack, &val);
+    }
+}
+
+/**
+ * Specializes the code of the function starting at pc, following
+ * each piece of the function.
+ */
+static void specializePieces(SpecState* state, size_t pc) {
+
+    lv_buf_init(&state->stack, sizeof(SpecValue));
+    lv_buf_init(&state->thunks, sizeof(SpecThunk));
+    while(true) {
+        size_t branch = specializeExpr(state, pc);
+        if(TEXT_BUFFER[branch].type == OPT_RETURN)
+            break;
+        size_t outBranch = state->out ? state->out->len - 1 : 0;
+        //the locals jump directly to the first piece
+        if(TEXT_BUFFER[branch].type != OPT_JUMP)
+            specializeExpr(state, branch + 1);
+        if(state->out) {
+            //the next piece directly follows the body in the copy
+            specCode(state, outBranch)->branchAddr = state->out->len - outBranch;
+        }
+        pc = branch + TEXT_BUFFER[branch].branchAddr;
+    }
+    lv_free(state->stack.data);
+    lv_free(state->thunks.data);
+}
+
+/**
+ * Gives spec its own copies of the arrays of func, which it was
+ * copied from.
+ */
+static void copyOperatorArrays(Operator* spec, Operator* func) {
+
+    if(func->captures) {
+        spec->captures = lv_alloc(func->captureCount * sizeof(int));
+        memcpy(spec->captures, func->captures, func->captureCount * sizeof(int));
+    }
+    if(func->paramTypes) {
+        spec->paramTypes = lv_alloc(func->arity * sizeof(unsigned));
+        memcpy(spec->paramTypes, func->paramTypes, func->arity * sizeof(unsigned));
+    }
+    spec->typedSpecs = 0;
+}
+
+/**
+ * Returns a copy of func specialized for the given constant function
+ * value of param. The copy calls the value directly instead of through
+ * OPT_FUNC_CALL2. If nothing in func depends on the value, returns func.
+ */
+static Operator* specialize(Operator* func, int param, Operator* value) {
+
+    if(func->type != FUN_FUNCTION)
+        return func;
+    Operator* spec = lv_op_getSpecialization(func, param, value);
+    if(spec) {
+        //specializations which would be the same share the code
+        return (spec->type == FUN_FUNCTION && spec->textOffset == func->textOffset)
+            ? func : spec;
+    }
+    spec = lv_alloc(sizeof(Operator));
+    *spec = *func;
+    spec->name = lv_alloc(strlen(func->name) + 1);
+    strcpy(spec->name, func->name);
+    copyOperatorArrays(spec, func);
+    spec->generic = func->generic ? func->generic : func;
+    //recursive uses refer to the specialization before it is done
+    spec->type = FUN_FWD_DECL;
+    lv_op_addSpecialization(spec, func, param, value);
+    DynBuffer out;
+    lv_buf_init(&out, sizeof(TextBufferObj));
+    SpecState state = { .param = param, .value = value, .out = &out, .changed = 0 };
+    specializePieces(&state, func->textOffset);
+    spec->type = FUN_FUNCTION;
+    if(state.changed) {
+        spec->textOffset = textBufferTop;
+        pushText(out.data, out.len);
+        lv_free(out.data);
+        lv_opt_optimize(spec);
+        return spec;
+    } else {
+        spec->textOffset = func->textOffset;
+        lv_expr_free(out.data, out.len);
+        return func;
+    }
+}
+
+//the most specializations made for the types of a function's params
+#define MAX_TYPED_SPECS 4
+
+Operator* lv_tb_specializeTypes(Operator* func, unsigned* types) {
+
+    if(func->type != FUN_FUNCTION || func->paramTypes)
+        return func;
+    Operator* spec = lv_op_getTypedSpecialization(func, types);
+    if(spec)
+        return spec;
+    if(func->typedSpecs == MAX_TYPED_SPECS)
+        return func;
+    func->typedSpecs++;
+    spec = lv_alloc(sizeof(Operator));
+    *spec = *func;
+    spec->name = lv_alloc(strlen(func->name) + 1);
+    strcpy(spec->name, func->name);
+    copyOperatorArrays(spec, func);
+    spec->paramTypes = lv_alloc(func->arity * sizeof(unsigned));
+    memcpy(spec->paramTypes, types, func->arity * sizeof(unsigned));
+    spec->generic = func->generic ? func->generic : func;
+    spec->type = FUN_FWD_DECL;
+    lv_op_addTypedSpecialization(spec, func, types);
+    //the copy starts out the same as func
+    DynBuffer out;
+    lv_buf_init(&out, sizeof(TextBufferObj));
+    SpecState state = { .param = -1, .value = NULL, .out = &out, .changed = 0 };
+    specializePieces(&state, func->textOffset);
+    spec->type = FUN_FUNCTION;
+    spec->textOffset = textBufferTop;
+    pushText(out.data, out.len);
+    lv_free(out.data);
+    //recursive calls with the same types are found while optimizing
+    lv_opt_optimize(spec);
+    return spec;
+}
+
+int lv_tb_specializeCalls(Operator* decl) {
+
+    SpecState state = { .param = -1, .value = NULL, .out = NULL, .changed = 0 };
+    specializePieces(&state, decl->textOffset);
+    return state.changed;
+}
+
+/**
+ * Returns 1 if the given condition is a constant true value, 0 if it
+ * is a constant false value, and -1 if it is not constant.
+ */
+static int constantCond(TextBufferObj* cond, size_t clen) {
+
+    if(clen != 1)
+        return -1;
+    switch(cond->type) {
+        case OPT_UNDEFINED:
+        case OPT_NUMBER:
+        case OPT_INTEGER:
+        case OPT_FUNCTION_VAL:
+            return lv_blt_toBool(cond);
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Sets the branch at idx to the top of the text buffer. If the
+ * branch is the locals jump to the next instruction, it is removed.
+ */
+static void branchToTop(size_t idx) {
+
+    if(lv_optLevel >= 1
+        && TEXT_BUFFER[idx].type == OPT_JUMP
+        && idx == textBufferTop - 1) {
+        textBufferTop--;
+    } else {
+        TEXT_BUFFER[idx].branchAddr = textBufferTop - idx;
+    }
+}
+
 Token* lv_tb_defineFunctionBody(Token* head, Operator* decl) {
 
     //save the top so we can roll back if necessary
@@ -291,6 +963,12 @@ Token* lv_tb_defineFunctionBody(Token* head, Operator* decl) {
             rollback(decl, top);
             return NULL;
         }
+        //or by name params
+        if(decl->byName) {
+            LV_EXPR_ERROR = XPE_BAD_ARGS;
+            rollback(decl, top);
+            return NULL;
+        }
         //only intrinsics supported for now
         Builtin func = lv_blt_getIntrinsic(decl->name);
         if(!func) {
@@ -311,10 +989,25 @@ Token* lv_tb_defineFunctionBody(Token* head, Operator* decl) {
         rollback(decl, top);
         return NULL;
     }
+    //by name params evaluated before the first branch are strict
+    uint64_t forced = 0;
     if(setbgn) {
         //set the branch addr to the top for local jump
         prevCondBranch = textBufferTop - 1;
+        //locals are initialized in sequence without nested functions
+        forced |= forcedParams(TEXT_BUFFER + top, textBufferTop - top);
     }
+    bool firstExpr = true;
+    bool objectGuard = false;
+    //whether the piece is emitted, and whether any later piece can run
+    bool emit = true;
+    bool reachable = true;
+    //consecutive guards comparing a param to function values
+    //are compiled to a dispatch table (see isLiteralGuard)
+    size_t dispatch = 0;    //the OPT_DISPATCH instruction
+    int dispatchLen = 0;    //number of guards, 0 if none
+    int dispatchParam = 0;
+    bool dispatchObjects = false;
     while(!isExprEnd(head)) {
         TextBufferObj* text;
         size_t len;
@@ -349,25 +1042,62 @@ Token* lv_tb_defineFunctionBody(Token* head, Operator* decl) {
                     lv_expr_free(text, len);
                     return NULL;
                 }
-                if(prevCondBranch) {
-                    //set the previous beanch statement's relative address.
-                    //The beginning of the current condition will be placed
-                    //at textBufferTop.
-                    TEXT_BUFFER[prevCondBranch].branchAddr = textBufferTop - prevCondBranch;
+                if(firstExpr) {
+                    forced |= forcedParams(cond + 1, clen - 1);
+                    objectGuard = isObjectGuard(decl, cond + 1, clen - 1, text + 1, len - 1);
                 }
-                //set the branch to the next condition, which usually
-                //occurs at (len + 1) after the branch instruction,
-                //but may be later becuase of nested function definitions.
-                end.type = OPT_BEQZ;
-                end.branchAddr = 0; //sentinel, will update later
-                if(!setbgn) {
-                    //only set fbgn on first run
-                    fbgn = textBufferTop;
-                    setbgn = true;
+                //pieces after one that always runs and pieces that
+                //never run are left out
+                int constant = lv_optLevel >= 1 ? constantCond(cond + 1, clen - 1) : -1;
+                emit = reachable && constant != 0;
+                if(emit) {
+                    if(prevCondBranch) {
+                        //set the previous beanch statement's relative address.
+                        //The beginning of the current condition will be placed
+                        //at textBufferTop.
+                        branchToTop(prevCondBranch);
+                    }
+                    //set the branch to the next condition, which usually
+                    //occurs at (len + 1) after the branch instruction,
+                    //but may be later becuase of nested function definitions.
+                    end.type = OPT_BEQZ;
+                    end.branchAddr = 0; //sentinel, will update later
+                    if(!setbgn) {
+                        //only set fbgn on first run
+                        fbgn = textBufferTop;
+                        setbgn = true;
+                    }
+                    int param;
+                    bool checkObjects;
+                    bool guard = lv_optLevel >= 1
+                        && isLiteralGuard(cond + 1, clen - 1, &param, &checkObjects);
+                    if(dispatchLen > 0 && !(guard
+                        && param == dispatchParam
+                        && checkObjects == dispatchObjects)) {
+                        finishDispatch(dispatch, dispatchLen, textBufferTop,
+                            dispatchParam, dispatchObjects);
+                        dispatchLen = 0;
+                    }
+                    if(guard) {
+                        if(dispatchLen == 0) {
+                            TextBufferObj obj = { .type = OPT_DISPATCH, .table = NULL };
+                            dispatch = textBufferTop;
+                            dispatchParam = param;
+                            dispatchObjects = checkObjects;
+                            pushText(&obj, 1);
+                        }
+                        dispatchLen++;
+                    }
+                    if(constant == 1) {
+                        //the body always runs, so there is no branch
+                        prevCondBranch = 0;
+                        reachable = false;
+                    } else {
+                        pushText(cond + 1, clen - 1);
+                        pushText(&end, 1);
+                        prevCondBranch = textBufferTop - 1;
+                    }
                 }
-                pushText(cond + 1, clen - 1);
-                pushText(&end, 1);
-                prevCondBranch = textBufferTop - 1;
                 //another function body?
                 if(head) {
                     if(strcmp(head->value, "=>") == 0) {
@@ -387,10 +1117,13 @@ Token* lv_tb_defineFunctionBody(Token* head, Operator* decl) {
                         return NULL;
                     }
                 }
-                lv_free(cond);
+                if(emit && constant != 1)
+                    lv_free(cond);
+                else
+                    lv_expr_free(cond, clen);
             } else if(prevCondBranch) {
                 //set locals jump to the first instruction of the body
-                TEXT_BUFFER[prevCondBranch].branchAddr = textBufferTop - prevCondBranch;
+                branchToTop(prevCondBranch);
             }
         } else if(conditional) {
             //function did not have a condition for one of its bodies
@@ -400,7 +1133,14 @@ Token* lv_tb_defineFunctionBody(Token* head, Operator* decl) {
             return NULL;
         } else if(prevCondBranch) {
             //set locals jump to the first instruction of the body
-            TEXT_BUFFER[prevCondBranch].branchAddr = textBufferTop - prevCondBranch;
+            branchToTop(prevCondBranch);
+        }
+        if(firstExpr && !conditional)
+            forced |= forcedParams(text + 1, len - 1);
+        firstExpr = false;
+        if(!emit) {
+            lv_expr_free(text, len);
+            continue;
         }
         if(!setbgn) {
             fbgn = textBufferTop;
@@ -411,10 +1151,19 @@ Token* lv_tb_defineFunctionBody(Token* head, Operator* decl) {
         pushText(&end, 1);
         lv_free(text);
     }
-    if(conditional) {
+    if(conditional && reachable) {
         if(prevCondBranch) {
             //set the last conditional branch
-            TEXT_BUFFER[prevCondBranch].branchAddr = textBufferTop - prevCondBranch;
+            branchToTop(prevCondBranch);
+        }
+        if(dispatchLen > 0) {
+            finishDispatch(dispatch, dispatchLen, textBufferTop,
+                dispatchParam, dispatchObjects);
+        }
+        if(!setbgn) {
+            //every piece was left out
+            fbgn = textBufferTop;
+            setbgn = true;
         }
         //push the default case (return undefined)
         TextBufferObj nan[2];
@@ -427,8 +1176,15 @@ Token* lv_tb_defineFunctionBody(Token* head, Operator* decl) {
         lv_free(decl->params[i].name);
     lv_free(decl->params);
     //set out param value
+    decl->strict = forced & decl->byName;
+    if(objectGuard) {
+        decl->objectLike = OBJ_YES;
+    } else if(!acceptsOneArg(decl)) {
+        decl->objectLike = OBJ_NO;
+    }
     decl->type = FUN_FUNCTION;
     decl->textOffset = fbgn;
+    lv_opt_optimize(decl);
     if(lv_debug) {
         //print function info
         printf("Function name=%s, arity=%d, capture=%d, locals=%d, fixing=%c, varargs=%s, offset=%u\n",
@@ -502,22 +1258,41 @@ static bool parseFunctionLocals(Operator* decl) {
         TextBufferObj put = { .type = OPT_PUT_PARAM, .param = i + decl->arity };
         pushText(&put, 1);
     }
-    TextBufferObj jump[2] = {
-        { .type = OPT_NUMBER, .number = 0 },
-        { .type = OPT_BEQZ, .branchAddr = 0 }
-    };
-    pushText(jump, 2);
+    TextBufferObj jump = { .type = OPT_JUMP, .branchAddr = 0 };
+    pushText(&jump, 1);
     return true;
 }
 
 static size_t startOfTmpExpr;
+//the functions defined by the expression come before it
+static size_t startOfTmpFuncs;
+static OpMark tmpFuncsMark;
+
+/**
+ * Frees the code and the functions made for the current
+ * expression, so the text buffer does not grow with each one.
+ */
+static void releaseExpr(void) {
+
+    for(size_t i = startOfTmpFuncs; i < textBufferTop; i++) {
+        if(TEXT_BUFFER[i].type == OPT_DISPATCH)
+            lv_free(TEXT_BUFFER[i].table);
+    }
+    lv_expr_cleanup(TEXT_BUFFER + startOfTmpFuncs, textBufferTop - startOfTmpFuncs);
+    lv_op_release(tmpFuncsMark);
+    textBufferTop = startOfTmpFuncs;
+    startOfTmpExpr = textBufferTop;
+}
 
 Token* lv_tb_parseExpr(Token* tokens, Operator* scope, size_t* start, size_t* end) {
 
     TextBufferObj* tmp;
     size_t tlen;
+    startOfTmpFuncs = textBufferTop;
+    tmpFuncsMark = lv_op_mark();
     Token* ret = lv_expr_parseExpr(tokens, scope, &tmp, &tlen);
     if(LV_EXPR_ERROR) {
+        releaseExpr();
         return NULL;
     }
     //add expr to buffer and set start of expr
@@ -531,9 +1306,7 @@ Token* lv_tb_parseExpr(Token* tokens, Operator* scope, size_t* start, size_t* en
 
 void lv_tb_clearExpr(void) {
 
-    lv_expr_cleanup(TEXT_BUFFER + startOfTmpExpr, textBufferTop - startOfTmpExpr);
-    textBufferTop = startOfTmpExpr;
-    startOfTmpExpr = textBufferTop;
+    releaseExpr();
 }
 
 void lv_tb_onStartup(void) {
@@ -547,5 +1320,9 @@ void lv_tb_onStartup(void) {
 
 void lv_tb_onShutdown(void) {
 
+    for(size_t i = 0; i < textBufferTop; i++) {
+        if(TEXT_BUFFER[i].type == OPT_DISPATCH)
+            lv_free(TEXT_BUFFER[i].table);
+    }
     lv_expr_free(TEXT_BUFFER, textBufferTop);
 }
@@ -4,12 +4,14 @@
 #include "operator_fwd.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 /**
  * Lavender's built in string object.
  */
 struct LvString {
     size_t refCount;
+    size_t hash;    //structural hash, or 0 if not yet computed
     size_t len;
     char value[];
 };
@@ -26,14 +28,26 @@ struct TextBufferObj {
         uint64_t integer;
         LvString* str;
         LvVect* vect;
+        LvMap* map;
+        LvSorted* sorted;
+        LvList* list;
+        LvSeq* seq;
+        LvRange* range;
+        LvCoroutine* coroutine;
         int param;
         Operator* func;
+        CaptureObj* capture;
         struct {
-            CaptureObj* capture;
-            Operator* capfunc;
+            int thunkAddr;  //first instruction of the argument
+            uint32_t thunkFp;   //frame the argument is evaluated in
         };
         int callArity;
         int branchAddr;
+        DispatchTable* table;
+        struct {
+            int regParam;   //the first operand, a param
+            int regArgs;    //number of operands
+        };
         size_t addr;
         char literal;
         size_t* refCount; //aliases (dynamic obj)->refCount
@@ -44,20 +58,97 @@ struct TextBufferObj {
  * Dynamically allocated capture arguments.
  * Captures keep a refCount of all the times they
  * are referred to. e.g. the stack and another capture
- * object.
+ * object. The captured function is stored here rather
+ * than in each value referring to the capture.
  */
 struct CaptureObj {
     size_t refCount;
+    size_t hash;    //structural hash, or 0 if not yet computed
+    Operator* func;
     TextBufferObj value[];
 };
 
 /**
- * Vector object.
+ * Vector object. Short vectors store their elements inline in data.
+ * Long vectors built by concatenation, slicing, or updates may instead
+ * keep them in a tree of nodes shared between vectors (see vect.c),
+ * in which case data is empty. Vectors of only numbers or only ints
+ * may be packed, storing the bare doubles or integers in data.
+ * Use lv_vect_get to access elements.
  */
 struct LvVect {
     size_t refCount;
+    size_t hash;    //structural hash, or 0 if not yet computed
     size_t len;
+    struct VectNode* tree;  //the elements, or NULL if they are in data
+    OpType packed;  //OPT_NUMBER or OPT_INTEGER if packed, else OPT_UNDEFINED
     TextBufferObj data[];
 };
 
+/**
+ * Immutable hash map object. The entries are stored in a
+ * trie of nodes shared between maps (see map.c).
+ */
+struct LvMap {
+    size_t refCount;
+    size_t hash;    //structural hash, or 0 if not yet computed
+    size_t len;
+    struct MapNode* root;   //NULL if the map is empty
+};
+
+/**
+ * Immutable sorted map or set object. The entries are stored
+ * in a B-tree of nodes shared between sorted maps (see sorted.c).
+ */
+struct LvSorted {
+    size_t refCount;
+    size_t hash;    //structural hash, or 0 if not yet computed
+    size_t len;
+    bool set;       //whether this is a sorted set
+    struct SortedNode* root;    //NULL if empty
+};
+
+/**
+ * Immutable linked list cell. Cells are shared between the lists
+ * consed onto them. The empty list is a cell of length 0.
+ */
+struct LvList {
+    size_t refCount;
+    size_t hash;    //structural hash, or 0 if not yet computed
+    size_t len;
+    TextBufferObj head; //unused if the list is empty
+    LvList* tail;       //NULL if len <= 1
+};
+
+/**
+ * Immutable range of ints from start, counting by step, up to
+ * but not including stop. The elements are not stored.
+ */
+struct LvRange {
+    size_t refCount;
+    size_t hash;    //structural hash, or 0 if not yet computed
+    size_t len;
+    uint64_t start;
+    uint64_t stop;  //as given, which may not be start + len * step
+    uint64_t step;  //nonzero, and negative to count down
+};
+
+/**
+ * Jump table for a sequence of guards of the form `param = \func`
+ * (using global:= or sys:__eq__). Entries are keyed on the
+ * function and hold the relative address of the guarded body.
+ */
+struct DispatchTable {
+    int param;          //param compared against
+    int end;            //relative address of the code after the guards
+    bool checkObjects;  //the guards use global:=
+    bool checked;       //the functions were checked for object-likeness
+    bool usable;        //the table gives the same result as the guards
+    size_t size;        //number of entries, a power of two
+    struct DispatchEntry {
+        Operator* func;
+        int target;
+    } entries[];
+};
+
 #endif
@@ -14,6 +14,7 @@ typedef enum OpType {
     OPT_PARAM,          //function parameter
     OPT_PUT_PARAM,      //store top in param
     OPT_FUNCTION,       //function definition
+    OPT_REG_CALL,       //builtin call reading its operands in place
     OPT_FUNCTION_VAL,   //function value
     OPT_FUNC_CAP,       //capture function with params
     OPT_FUNC_CALL,      //call value as function (bracket notation)
@@ -21,6 +22,12 @@ typedef enum OpType {
     OPT_MAKE_VECT,      //make vector from args
     OPT_RETURN,         //return from function
     OPT_BEQZ,           //relative branch if zero
+    OPT_JUMP,           //relative branch
+    OPT_DISPATCH,       //relative branch through a guard table
+    OPT_FORCE,          //push by name param, evaluating it if needed
+    OPT_MAKE_THUNK,     //delay the following by name argument
+    OPT_END_THUNK,      //end of by name argument code
+    OPT_THUNK,          //unevaluated by name argument (not present in text buffer)
     OPT_ADDR,           //internal address (not present in text buffer)
     OPT_LITERAL,        //literal value (not present in final code)
     OPT_EMPTY_ARGS,     //empty args placeholder (not present in final code)
@@ -28,12 +35,25 @@ typedef enum OpType {
         LV_DYNAMIC,     //Lavender string
     OPT_VECT,           //Lavender vector
     OPT_CAPTURE,        //function value with captured params
+    OPT_MAP,            //Lavender hash map
+    OPT_SORTED,         //Lavender sorted map or set
+    OPT_LIST,           //Lavender linked list
+    OPT_SEQ,            //Lavender lazy sequence
+    OPT_RANGE,          //Lavender range of ints
+    OPT_COROUTINE,      //Lavender coroutine
 } OpType;
 
 typedef struct TextBufferObj TextBufferObj;
 typedef struct CaptureObj CaptureObj;
 typedef struct LvString LvString;
 typedef struct LvVect LvVect;
+typedef struct LvMap LvMap;
+typedef struct LvSorted LvSorted;
+typedef struct LvList LvList;
+typedef struct LvSeq LvSeq;
+typedef struct LvRange LvRange;
+typedef struct LvCoroutine LvCoroutine;
+typedef struct DispatchTable DispatchTable;
 
 TextBufferObj* TEXT_BUFFER;
 
@@ -69,10 +89,32 @@ Token* lv_tb_defineFunctionBody(Token* tokens, Operator* decl);
 Token* lv_tb_parseExpr(Token* tokens, Operator* scope, size_t* start, size_t* end);
 
 /**
- * Clears the text buffer of any data associated with the previous parsed expression.
+ * Clears the text buffer of any data associated with the previous parsed expression,
+ * including the functions defined and specialized while parsing it.
  */
 void lv_tb_clearExpr(void);
 
+/**
+ * Returns the relative address of the body guarded by the given function
+ * in the given dispatch table, or the address after the guards if there
+ * is no such guard.
+ */
+int lv_tb_dispatch(DispatchTable* table, Operator* func);
+
+/**
+ * Specializes the functions the given function passes constant
+ * function values to. Returns the number of calls specialized.
+ */
+int lv_tb_specializeCalls(Operator* decl);
+
+/**
+ * Returns a copy of the function whose params are known to have the
+ * given types, as sets of the types tracked by the type inference pass,
+ * and which is optimized for them. Returns the function itself if it
+ * cannot be copied, or if it has been copied for too many types.
+ */
+Operator* lv_tb_specializeTypes(Operator* func, unsigned* types);
+
 void lv_tb_onStartup(void);
 void lv_tb_onShutdown(void);
 
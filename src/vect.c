@@ -0,0 +1,445 @@
+#include "vect.h"
+#include "expression.h"
+#include "lavender.h"
+#include <string.h>
+#include <assert.h>
+
+#define LEAF_MAX 32 //maximum elements in a leaf
+
+/**
+ * A node of a vector tree. Leaves hold up to LEAF_MAX elements, and
+ * branches hold the concatenation of their children. The tree is
+ * kept balanced as an AVL tree, so the heights of the children of a
+ * branch differ by at most one. Nodes are shared between vectors and
+ * keep a refCount of the vectors and nodes referring to them.
+ *
+ * Functions returning a node return a reference owned by the caller,
+ * and functions taking a node only borrow it.
+ */
+typedef struct VectNode VectNode;
+struct VectNode {
+    size_t refCount;
+    size_t len;     //number of elements in the subtree
+    int height;     //0 for leaves
+    VectNode* left;
+    VectNode* right;
+    TextBufferObj data[];   //the elements, if this is a leaf
+};
+
+static void incRefCount(TextBufferObj* obj) {
+
+    if(obj->type & LV_DYNAMIC)
+        ++*obj->refCount;
+}
+
+static VectNode* retain(VectNode* node) {
+
+    if(node)
+        node->refCount++;
+    return node;
+}
+
+static void release(VectNode* node) {
+
+    if(node) {
+        assert(node->refCount);
+        if(--node->refCount == 0) {
+            if(node->height == 0) {
+                lv_expr_cleanup(node->data, node->len);
+            } else {
+                release(node->left);
+                release(node->right);
+            }
+            lv_free(node);
+        }
+    }
+}
+
+static int height(VectNode* node) {
+
+    return node ? node->height : -1;
+}
+
+static size_t length(VectNode* node) {
+
+    return node ? node->len : 0;
+}
+
+/** Copies the elements of the subtree to dest. */
+static void copyElements(VectNode* node, TextBufferObj* dest) {
+
+    if(node->height == 0) {
+        memcpy(dest, node->data, node->len * sizeof(TextBufferObj));
+    } else {
+        copyElements(node->left, dest);
+        copyElements(node->right, dest + node->left->len);
+    }
+}
+
+static VectNode* allocLeaf(size_t len) {
+
+    assert(len <= LEAF_MAX);
+    VectNode* leaf = lv_alloc(sizeof(VectNode) + len * sizeof(TextBufferObj));
+    leaf->refCount = 1;
+    leaf->len = len;
+    leaf->height = 0;
+    leaf->left = leaf->right = NULL;
+    return leaf;
+}
+
+static VectNode* leafOf(TextBufferObj* data, size_t len) {
+
+    VectNode* leaf = allocLeaf(len);
+    for(size_t i = 0; i < len; i++) {
+        leaf->data[i] = data[i];
+        incRefCount(&leaf->data[i]);
+    }
+    return leaf;
+}
+
+static VectNode* branch(VectNode* left, VectNode* right) {
+
+    VectNode* node = lv_alloc(sizeof(VectNode));
+    node->refCount = 1;
+    node->len = left->len + right->len;
+    node->height = 1 + (left->height > right->height ? left->height : right->height);
+    node->left = retain(left);
+    node->right = retain(right);
+    return node;
+}
+
+/** Builds a branch, with rotations if the heights differ by two. */
+static VectNode* balance(VectNode* left, VectNode* right) {
+
+    VectNode* inner;
+    VectNode* outer;
+    VectNode* res;
+    if(left->height > right->height + 1) {
+        if(height(left->left) >= height(left->right)) {
+            inner = branch(left->right, right);
+            res = branch(left->left, inner);
+        } else {
+            VectNode* mid = left->right;
+            outer = branch(left->left, mid->left);
+            inner = branch(mid->right, right);
+            res = branch(outer, inner);
+            release(outer);
+        }
+        release(inner);
+    } else if(right->height > left->height + 1) {
+        if(height(right->right) >= height(right->left)) {
+            inner = branch(left, right->left);
+            res = branch(inner, right->right);
+        } else {
+            VectNode* mid = right->left;
+            inner = branch(left, mid->left);
+            outer = branch(mid->right, right->right);
+            res = branch(inner, outer);
+            release(outer);
+        }
+        release(inner);
+    } else {
+        res = branch(left, right);
+    }
+    return res;
+}
+
+/**
+ * Joins two trees, either of which may be NULL. Short edges are
+ * merged into a single leaf, so repeatedly appending single
+ * elements fills the leaves instead of creating one per element.
+ */
+static VectNode* join(VectNode* left, VectNode* right) {
+
+    if(!left || !right)
+        return retain(left ? left : right);
+    if(left->len + right->len <= LEAF_MAX) {
+        VectNode* leaf = allocLeaf(left->len + right->len);
+        copyElements(left, leaf->data);
+        copyElements(right, leaf->data + left->len);
+        for(size_t i = 0; i < leaf->len; i++)
+            incRefCount(&leaf->data[i]);
+        return leaf;
+    }
+    VectNode* tmp;
+    VectNode* res;
+    if(left->height > right->height + 1
+        || (left->height > right->height && left->right->len + right->len <= LEAF_MAX)) {
+        tmp = join(left->right, right);
+        res = balance(left->left, tmp);
+    } else if(right->height > left->height + 1
+        || (right->height > left->height && left->len + right->left->len <= LEAF_MAX)) {
+        tmp = join(left, right->left);
+        res = balance(tmp, right->right);
+    } else {
+        return branch(left, right);
+    }
+    release(tmp);
+    return res;
+}
+
+/** Splits a tree into its first idx elements and the rest. */
+static void split(VectNode* node, size_t idx, VectNode** left, VectNode** right) {
+
+    VectNode* tmp;
+    if(idx == 0) {
+        *left = NULL;
+        *right = retain(node);
+    } else if(idx == node->len) {
+        *left = retain(node);
+        *right = NULL;
+    } else if(node->height == 0) {
+        *left = leafOf(node->data, idx);
+        *right = leafOf(node->data + idx, node->len - idx);
+    } else if(idx <= node->left->len) {
+        split(node->left, idx, left, &tmp);
+        *right = join(tmp, node->right);
+        release(tmp);
+    } else {
+        split(node->right, idx - node->left->len, &tmp, right);
+        *left = join(node->left, tmp);
+        release(tmp);
+    }
+}
+
+static VectNode* update(VectNode* node, size_t idx, TextBufferObj* value) {
+
+    if(node->height == 0) {
+        VectNode* leaf = leafOf(node->data, node->len);
+        lv_expr_cleanup(&leaf->data[idx], 1);
+        leaf->data[idx] = *value;
+        incRefCount(&leaf->data[idx]);
+        return leaf;
+    }
+    VectNode* child;
+    VectNode* res;
+    if(idx < node->left->len) {
+        child = update(node->left, idx, value);
+        res = branch(child, node->right);
+    } else {
+        child = update(node->right, idx - node->left->len, value);
+        res = branch(node->left, child);
+    }
+    release(child);
+    return res;
+}
+
+/** Builds a balanced tree of the given elements. */
+static VectNode* build(TextBufferObj* data, size_t len) {
+
+    if(len <= LEAF_MAX)
+        return leafOf(data, len);
+    //split on a leaf boundary so the leaves are full
+    size_t leaves = (len + LEAF_MAX - 1) / LEAF_MAX;
+    size_t mid = (leaves / 2) * LEAF_MAX;
+    VectNode* left = build(data, mid);
+    VectNode* right = build(data + mid, len - mid);
+    VectNode* res = branch(left, right);
+    release(left);
+    release(right);
+    return res;
+}
+
+static VectNode* toTree(LvVect* vect) {
+
+    if(vect->tree)
+        return retain(vect->tree);
+    if(vect->len == 0)
+        return NULL;
+    if(vect->packed == OPT_UNDEFINED)
+        return build(vect->data, vect->len);
+    TextBufferObj* data = lv_alloc(vect->len * sizeof(TextBufferObj));
+    lv_vect_copy(vect, data);
+    VectNode* tree = build(data, vect->len);
+    lv_free(data);
+    return tree;
+}
+
+static LvVect* allocFlat(size_t len) {
+
+    LvVect* vect = lv_alloc(sizeof(LvVect) + len * sizeof(TextBufferObj));
+    vect->refCount = 0;
+    vect->hash = 0;
+    vect->len = len;
+    vect->tree = NULL;
+    vect->packed = OPT_UNDEFINED;
+    return vect;
+}
+
+LvVect* lv_vect_newPacked(OpType type, size_t len) {
+
+    assert(type == OPT_NUMBER || type == OPT_INTEGER);
+    //doubles and integers are the same size
+    LvVect* vect = lv_alloc(sizeof(LvVect) + len * sizeof(double));
+    vect->refCount = 0;
+    vect->hash = 0;
+    vect->len = len;
+    vect->tree = NULL;
+    vect->packed = type;
+    return vect;
+}
+
+LvVect* lv_vect_pack(LvVect* vect) {
+
+    if(vect->packed != OPT_UNDEFINED || vect->len == 0)
+        return NULL;
+    OpType type = lv_vect_get(vect, 0).type;
+    if(type != OPT_NUMBER && type != OPT_INTEGER)
+        return NULL;
+    for(size_t i = 1; i < vect->len; i++) {
+        if(lv_vect_get(vect, i).type != type)
+            return NULL;
+    }
+    LvVect* res = lv_vect_newPacked(type, vect->len);
+    for(size_t i = 0; i < vect->len; i++) {
+        //numbers and integers share the representation of the union
+        lv_vect_integers(res)[i] = lv_vect_get(vect, i).integer;
+    }
+    return res;
+}
+
+/** Wraps a tree in a vector, flattening it if it is short. */
+static LvVect* fromTree(VectNode* tree) {
+
+    LvVect* vect;
+    if(length(tree) < LV_VECT_TREE_MIN) {
+        vect = allocFlat(length(tree));
+        if(tree)
+            copyElements(tree, vect->data);
+        for(size_t i = 0; i < vect->len; i++)
+            incRefCount(&vect->data[i]);
+        release(tree);
+    } else {
+        vect = allocFlat(0);
+        vect->len = tree->len;
+        vect->tree = tree;
+    }
+    return vect;
+}
+
+TextBufferObj* lv_vect_treeAt(VectNode* tree, size_t idx) {
+
+    assert(idx < tree->len);
+    while(tree->height) {
+        if(idx < tree->left->len) {
+            tree = tree->left;
+        } else {
+            idx -= tree->left->len;
+            tree = tree->right;
+        }
+    }
+    return &tree->data[idx];
+}
+
+LvVect* lv_vect_concat(LvVect* a, LvVect* b) {
+
+    if(a->packed != OPT_UNDEFINED && a->packed == b->packed) {
+        LvVect* vect = lv_vect_newPacked(a->packed, a->len + b->len);
+        memcpy(vect->data, a->data, a->len * sizeof(double));
+        memcpy(lv_vect_numbers(vect) + a->len, b->data, b->len * sizeof(double));
+        return vect;
+    }
+    if(a->len + b->len < LV_VECT_TREE_MIN) {
+        LvVect* vect = allocFlat(a->len + b->len);
+        lv_vect_copy(a, vect->data);
+        lv_vect_copy(b, vect->data + a->len);
+        for(size_t i = 0; i < vect->len; i++)
+            incRefCount(&vect->data[i]);
+        return vect;
+    }
+    VectNode* left = toTree(a);
+    VectNode* right = toTree(b);
+    VectNode* tree = join(left, right);
+    release(left);
+    release(right);
+    return fromTree(tree);
+}
+
+LvVect* lv_vect_cat(TextBufferObj* objs, size_t count) {
+
+    VectNode* tree = NULL;
+    size_t i = 0;
+    while(i < count) {
+        VectNode* part;
+        if(objs[i].type == OPT_VECT) {
+            part = toTree(objs[i].vect);
+            i++;
+        } else {
+            //gather a run of elements into leaves
+            size_t run = 1;
+            while(i + run < count && objs[i + run].type != OPT_VECT)
+                run++;
+            part = build(&objs[i], run);
+            i += run;
+        }
+        VectNode* tmp = join(tree, part);
+        release(tree);
+        release(part);
+        tree = tmp;
+    }
+    return fromTree(tree);
+}
+
+LvVect* lv_vect_slice(LvVect* vect, size_t start, size_t end) {
+
+    assert(start <= end && end <= vect->len);
+    if(vect->packed != OPT_UNDEFINED) {
+        LvVect* res = lv_vect_newPacked(vect->packed, end - start);
+        memcpy(res->data, lv_vect_numbers(vect) + start, res->len * sizeof(double));
+        return res;
+    }
+    if(!vect->tree || end - start < LV_VECT_TREE_MIN) {
+        LvVect* res = allocFlat(end - start);
+        for(size_t i = 0; i < res->len; i++) {
+            res->data[i] = lv_vect_get(vect, start + i);
+            incRefCount(&res->data[i]);
+        }
+        return res;
+    }
+    VectNode* left;
+    VectNode* mid;
+    VectNode* right;
+    split(vect->tree, end, &left, &right);
+    release(right);
+    split(left, start, &right, &mid);
+    release(left);
+    release(right);
+    return fromTree(mid);
+}
+
+LvVect* lv_vect_update(LvVect* vect, size_t idx, TextBufferObj* value) {
+
+    assert(idx < vect->len);
+    if(vect->packed != OPT_UNDEFINED && vect->packed == value->type) {
+        LvVect* res = lv_vect_newPacked(vect->packed, vect->len);
+        memcpy(res->data, vect->data, vect->len * sizeof(double));
+        lv_vect_integers(res)[idx] = value->integer;
+        return res;
+    }
+    VectNode* tree = toTree(vect);
+    VectNode* res = update(tree, idx, value);
+    release(tree);
+    return fromTree(res);
+}
+
+void lv_vect_copy(LvVect* vect, TextBufferObj* dest) {
+
+    if(vect->tree) {
+        copyElements(vect->tree, dest);
+    } else if(vect->packed != OPT_UNDEFINED) {
+        for(size_t i = 0; i < vect->len; i++)
+            dest[i] = lv_vect_get(vect, i);
+    } else {
+        memcpy(dest, vect->data, vect->len * sizeof(TextBufferObj));
+    }
+}
+
+void lv_vect_free(LvVect* vect) {
+
+    assert(vect->refCount == 0);
+    if(vect->tree)
+        release(vect->tree);
+    else if(vect->packed == OPT_UNDEFINED)
+        lv_expr_cleanup(vect->data, vect->len);
+    lv_free(vect);
+}
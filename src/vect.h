@@ -0,0 +1,97 @@
+#ifndef VECT_H
+#define VECT_H
+#include "textbuffer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Long Lavender vectors are kept in persistent balanced trees of
+ * short leaf arrays, so that concatenation, slicing, and updates take
+ * logarithmic time and share most of their nodes with the original.
+ * Vectors shorter than LV_VECT_TREE_MIN are always flat. Flat vectors
+ * of only numbers or only ints may also be packed into bare doubles or
+ * integers, which take half the space and suit vectorized kernels.
+ * Vectors returned by these functions are new values with a refCount
+ * of 0, except where noted.
+ */
+
+#define LV_VECT_TREE_MIN 64
+//vectors built by map and filter are packed if at least this long
+#define LV_VECT_PACK_MIN 16
+
+/** Returns the element of a tree vector at the given index. */
+TextBufferObj* lv_vect_treeAt(struct VectNode* tree, size_t idx);
+
+/** Returns the elements of a vector packed with OPT_NUMBER. */
+static inline double* lv_vect_numbers(LvVect* vect) {
+
+    return (double*)vect->data;
+}
+
+/** Returns the elements of a vector packed with OPT_INTEGER. */
+static inline uint64_t* lv_vect_integers(LvVect* vect) {
+
+    return (uint64_t*)vect->data;
+}
+
+/**
+ * Returns the element of the vector at the given index, which must be
+ * in bounds. The element is owned by the vector.
+ */
+static inline TextBufferObj lv_vect_get(LvVect* vect, size_t idx) {
+
+    TextBufferObj res;
+    if(vect->tree) {
+        res = *lv_vect_treeAt(vect->tree, idx);
+    } else if(vect->packed == OPT_NUMBER) {
+        res.type = OPT_NUMBER;
+        res.number = lv_vect_numbers(vect)[idx];
+    } else if(vect->packed == OPT_INTEGER) {
+        res.type = OPT_INTEGER;
+        res.integer = lv_vect_integers(vect)[idx];
+    } else {
+        res = vect->data[idx];
+    }
+    return res;
+}
+
+/** Returns a new vector of len elements packed with the given type. */
+LvVect* lv_vect_newPacked(OpType type, size_t len);
+
+/**
+ * Returns a packed copy of the vector if its elements are all numbers
+ * or all ints and it is not already packed, or NULL otherwise.
+ */
+LvVect* lv_vect_pack(LvVect* vect);
+
+/**
+ * Returns the concatenation of the given vectors. The result
+ * is packed if both vectors are packed with the same type.
+ */
+LvVect* lv_vect_concat(LvVect* a, LvVect* b);
+
+/**
+ * Returns the concatenation of the given objects, where vectors
+ * contribute their elements and other objects contribute themselves.
+ */
+LvVect* lv_vect_cat(TextBufferObj* objs, size_t count);
+
+/**
+ * Returns the elements from start up to but not including end.
+ * The result is packed if the vector is packed.
+ */
+LvVect* lv_vect_slice(LvVect* vect, size_t start, size_t end);
+
+/** Returns the vector with the element at idx replaced by the value. */
+LvVect* lv_vect_update(LvVect* vect, size_t idx, TextBufferObj* value);
+
+/**
+ * Copies the elements of the vector to dest, without incrementing
+ * their refCounts. Packed elements are unpacked.
+ */
+void lv_vect_copy(LvVect* vect, TextBufferObj* dest);
+
+/** Frees a vector whose refCount has reached 0. */
+void lv_vect_free(LvVect* vect);
+
+#endif